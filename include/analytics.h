@@ -0,0 +1,29 @@
+#ifndef ANALYTICS_H
+#define ANALYTICS_H
+
+#include <string>
+#include <vector>
+#include "jpeg.h"
+#include "file_io.h"
+
+const uint histogramLevels = 4; // per channel, the histogram has histogramLevels^3 bins
+
+// Coarse statistics of an image taken from the DC coefficients alone, without any IDCT or full size color conversion
+struct ImageAnalytics {
+	uint width = 0; // of the image
+	uint height = 0;
+	uint blocksWide = 0; // of the 1/8 scale image, one pixel per 8x8 block
+	uint blocksHigh = 0;
+	uint channels = 0; // 1 for grayscale, otherwise 3 (RGB)
+	std::vector<byte> pixels; // 1/8 scale image, row major, channels interleaved
+	double meanColor[3] = { 0.0 }; // RGB, equal channels for grayscale
+	uint histogram[histogramLevels * histogramLevels * histogramLevels] = { 0 }; // pixels per RGB bin, red most significant
+	uint64 perceptualHash = 0; // DCT hash of the luma, compare with the Hamming distance
+};
+
+// Entropy decodes the scan of jpeg keeping only DC coefficients and fills analytics, returns false on corrupt data
+bool analyzeDC(JPEGImage* const jpeg, ImageAnalytics& analytics);
+// One line summary: size, mean color, perceptual hash and histogram
+std::string formatAnalytics(const ImageAnalytics& analytics);
+
+#endif // ANALYTICS_H
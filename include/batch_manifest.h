@@ -0,0 +1,32 @@
+#ifndef BATCH_MANIFEST_H
+#define BATCH_MANIFEST_H
+
+#include <string>
+#include <map>
+#include "file_io.h"
+
+struct ManifestEntry {
+	uint64 size = 0;
+	uint64 modifiedTime = 0;
+	uint64 hash = 0; // 0 when the entry was recorded without hashing the content
+	std::string optionsKey;
+	std::string output;
+	uint64 outputSize = 0;
+};
+
+// Persistent record of finished conversions, lets incremental batch runs skip inputs that didn't change
+class BatchManifest {
+public:
+	BatchManifest(const std::string& path);
+	bool load();
+	bool save() const;
+	// True when input was converted before with the same options, is unchanged and its output is still on disk.
+	// byContent compares the content hash, otherwise size and modification time are trusted.
+	bool isUpToDate(const std::string& input, const ManifestEntry& current, bool byContent) const;
+	void record(const std::string& input, const ManifestEntry& entry);
+private:
+	std::string path;
+	std::map<std::string, ManifestEntry> entries;
+};
+
+#endif // BATCH_MANIFEST_H
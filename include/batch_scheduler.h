@@ -0,0 +1,43 @@
+#ifndef BATCH_SCHEDULER_H
+#define BATCH_SCHEDULER_H
+
+#include <vector>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include "file_io.h"
+
+// Runs the jobs of a batch on up to slots threads at once while the estimated peak memory of the running jobs stays
+// within budget. Jobs start in order as long as they fit. A job that does not fit may be overtaken by up to maxBypass
+// later, smaller ones, after that nothing new starts until it does, so large jobs wait for memory but never starve.
+// A job estimated above the whole budget runs alone.
+class BatchScheduler {
+public:
+	BatchScheduler(uint64 budget, uint slots, uint maxBypass);
+	BatchScheduler(const BatchScheduler&) = delete;
+	BatchScheduler& operator=(const BatchScheduler&) = delete;
+
+	// Runs job(i) for every i in [0, costs.size()), costs[i] being job i's estimated peak memory in bytes.
+	// job is called from several threads at once and has to synchronize whatever it shares.
+	void run(const std::vector<uint64>& costs, const std::function<void(size_t)>& job);
+	uint64 peakAdmitted() const; // largest sum of estimates that ran at the same time
+	uint maxConcurrency() const; // most jobs that ran at the same time
+private:
+	bool admit(const std::vector<uint64>& costs, size_t& index);
+	void worker(const std::vector<uint64>& costs, const std::function<void(size_t)>& job);
+
+	uint64 budget;
+	uint slots;
+	uint maxBypass;
+	std::vector<bool> started;
+	size_t head; // oldest job that has not started
+	uint headBypassed; // later jobs started while head was waiting
+	uint64 admitted; // estimates of the running jobs
+	uint running;
+	uint64 peak;
+	uint peakRunning;
+	std::mutex mutex;
+	std::condition_variable finished;
+};
+
+#endif // BATCH_SCHEDULER_H
@@ -9,6 +9,12 @@ public:
 	int readNextBit();
 	int readBits(const uint length);
 	void align();
+	// Next length (at most 16) bits without consuming them, zero padded past the end of data
+	uint peekBits(const uint length) const;
+	void skipBits(const uint length);
+	size_t position() const; // in bits from the start of data
+	void seek(size_t bitPosition);
+	size_t size() const; // in bits
 private:
 	const std::vector<byte>& data;
 	size_t byteIndex;
@@ -0,0 +1,21 @@
+#ifndef BIT_WRITER_H
+#define BIT_WRITER_H
+#include <vector>
+#include "utils.h"
+
+// Appends entropy coded bits MSB first, stuffing a 0x00 after every 0xFF byte
+class BitWriter {
+public:
+	BitWriter(std::vector<byte>& data);
+	void writeBits(const uint bits, const uint length);
+	void flush(); // pads the last byte with 1 bits
+	void writeMarker(const byte marker);
+private:
+	void putByte(const byte value);
+
+	std::vector<byte>& data;
+	uint buffer;
+	uint bufferLength;
+};
+
+#endif
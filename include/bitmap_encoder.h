@@ -0,0 +1,72 @@
+#ifndef BITMAP_ENCODER_H
+#define BITMAP_ENCODER_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstddef>
+#include "jpeg.h"
+#include "resampler.h"
+
+// Destination of source pixel (x, y) in a width x height image once EXIF orientation is applied
+void orientPixel(uint orientation, uint width, uint height, uint x, uint y, uint& dx, uint& dy);
+
+// Writes a BMP one MCU row at a time, in any order.
+// 24-bit files take RGB MCUs, 8-bit files get a grayscale palette and take GrayMCUs.
+// width and height are the stored dimensions, orientation is applied while the pixels are placed:
+// 1-4 stream each MCU row straight to its band of the file, 5-8 swap the axes and are kept in memory until the writer is destroyed.
+class BitmapRowWriter {
+public:
+	BitmapRowWriter(const std::string& filename, uint width, uint height, uint bitsPerPixel = 24, uint orientation = 1);
+	~BitmapRowWriter();
+	bool isOpen() const;
+	// Closes and deletes the file, for a decode that failed after the header was written
+	void discard();
+	void writeMCURow(uint mcuRow, const MCU* const rowMCUs);
+	void writeMCURow(uint mcuRow, const GrayMCU* const rowMCUs);
+	// One row of width pixels, RGB triples for 24-bit files and gray bytes for 8-bit files
+	void writeRow(uint row, const byte* const pixels);
+private:
+	std::ptrdiff_t fileOffset(uint x, uint y) const;
+	uint bandFileRow(uint firstRow, uint rows) const;
+	char* bandTarget(uint firstRow, uint rows, std::ptrdiff_t& origin);
+	void writeBand(uint firstRow, uint rows);
+
+	std::string filename;
+	std::ofstream outFile;
+	uint width;
+	uint height;
+	uint bytesPerPixel;
+	uint orientation;
+	bool transposed;
+	uint outWidth;
+	uint outHeight;
+	uint rowSize;
+	uint pixelOffset;
+	std::ptrdiff_t pixelStep; // file offset between horizontally adjacent source pixels
+	std::vector<char> band;
+	std::vector<char> image; // whole pixel array for the transposed orientations
+};
+
+// Turns MCU rows into pixel rows and streams them through a Resampler.
+// blockSize is the edge of the pixel block each 8x8 block was reduced to by the scaled IDCT (8, 4, 2 or 1),
+// width and height are the image size at that scale.
+class ResizingRowWriter {
+public:
+	ResizingRowWriter(uint width, uint height, uint blockSize, uint targetWidth, uint targetHeight, uint channels,
+		ResampleFilter filter, const Resampler::RowCallback& emit);
+	void writeMCURow(uint mcuRow, const MCU* const rowMCUs);
+	void writeMCURow(uint mcuRow, const GrayMCU* const rowMCUs);
+private:
+	uint width;
+	uint height;
+	uint blockSize;
+	uint channels;
+	Resampler resampler;
+	Resampler::RowCallback emit;
+	std::vector<byte> row;
+};
+
+void writePGMPixels(const std::string& savefile_name, const byte* const pixels, uint width, uint height, uint orientation);
+
+#endif // BITMAP_ENCODER_H
@@ -0,0 +1,20 @@
+#ifndef BYTE_READER_H
+#define BYTE_READER_H
+#include <vector>
+#include "utils.h"
+
+// Sequential reader over an in-memory file, get() mirrors std::istream::get() and returns -1 past the end
+class ByteReader {
+public:
+	ByteReader(const std::vector<byte>& data);
+	int get();
+	bool operator!() const; // true once a read past the end was attempted
+	size_t position() const;
+	void seek(size_t position);
+private:
+	const std::vector<byte>& data;
+	size_t index;
+	bool failed;
+};
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef COEFFICIENT_TRANSFORM_H
+#define COEFFICIENT_TRANSFORM_H
+
+#include "jpeg.h"
+
+// Geometry changes that map 8x8 blocks onto 8x8 blocks, done on quantized coefficients without any loss
+enum class LosslessTransform {
+	None,
+	Auto, // whatever turns the EXIF orientation upright
+	FlipHorizontal,
+	FlipVertical,
+	Rotate90, // clockwise
+	Rotate180,
+	Rotate270,
+	Transpose, // across the top left to bottom right diagonal
+	Transverse // across the top right to bottom left diagonal
+};
+
+// Region kept of the transformed image, the top left corner is moved up and left onto the block grid
+struct CropRegion {
+	uint x = 0;
+	uint y = 0;
+	uint width = 0; // 0 keeps everything right of x
+	uint height = 0; // 0 keeps everything below y
+};
+
+// The transform that undoes an EXIF orientation (1-8)
+LosslessTransform transformForOrientation(uint orientation);
+// Returns the transformed and cropped copy of image (natural coefficient order), or nullptr when the crop is empty.
+// Partial edge blocks that a flip would move to the left or top edge are trimmed, as they can't be mirrored in place.
+CoefficientImage* transformCoefficients(const CoefficientImage* const image, LosslessTransform transform, const CropRegion& crop);
+
+#endif // COEFFICIENT_TRANSFORM_H
@@ -0,0 +1,55 @@
+#ifndef DECODE_OPTIONS_H
+#define DECODE_OPTIONS_H
+
+#include <string>
+#include "utils.h"
+#include "resampler.h"
+#include "pixel_buffer.h"
+#include "coefficient_transform.h"
+
+struct DecodeOptions {
+	uint threadCount = 0; // 0 = one thread per hardware core
+	uint serialThreshold = 32; // images with fewer MCU rows than this skip the thread pool
+	bool pipelined = false; // overlap entropy decoding with the pixel stages
+	uint ringRows = 16; // MCU rows held in flight by the pipelined decoder
+	bool speculative = false; // split scans without restart markers across threads at guessed bit positions
+	bool coefficientsOnly = false; // dump quantized DCT coefficients instead of pixels
+	bool zigZagOrder = false; // coefficient dump order
+	bool outputJPEG = false; // re-encode as baseline JPEG instead of writing a BMP
+	uint quality = 0; // JPEG output quality, 0 keeps the source quantization tables
+	LosslessTransform transform = LosslessTransform::None; // rotate or mirror the coefficients for JPEG output
+	CropRegion crop; // region of the transformed image kept in JPEG output, cropping is on when a width is set
+	bool optimizeHuffman = false; // build JPEG output Huffman tables from a symbol histogram
+	uint restartInterval = 0; // JPEG output restart interval in MCUs, 0 for none
+	bool outputPGM = false; // write grayscale images as PGM instead of 8-bit BMP
+	bool incremental = false; // skip inputs whose manifest entry shows an up to date output
+	std::string manifestPath = ".picat_manifest";
+	bool cacheByContent = true; // compare content hashes, otherwise trust size and modification time
+	uint readAheadDepth = 4; // input files read in the background while earlier ones decode, 0 reads synchronously
+	uint readAheadMemoryMB = 256; // cap on the input bytes held by reads in flight
+	uint memoryBudgetMB = 0; // convert several inputs at once while their estimated decode memory fits, 0 converts one at a time
+	bool applyOrientation = true; // rotate and mirror bitmap output according to the EXIF orientation
+	uint resizeWidth = 0; // exact output size as displayed, a 0 side follows the aspect ratio
+	uint resizeHeight = 0;
+	uint maxEdge = 0; // scale so the longest displayed edge has this length, overrides resizeWidth/resizeHeight
+	ResampleFilter filter = ResampleFilter::Lanczos;
+	PixelFormat pixelFormat = PixelFormat::Bitmap; // raw BGRA32 or planar YCbCr instead of a BMP, in stored orientation
+	uint stride = 0; // bytes per raw output row, 0 for the row size rounded up to rowAlignment
+	uint rowAlignment = 1; // raw output rows start at multiples of this many bytes, a power of two
+	bool pyramid = false; // write a tile pyramid of every level down to a single tile instead of one image
+	uint tileSize = 256; // pyramid tile edge in pixels
+	uint thumbnailSize = 0; // decode the EXIF thumbnail instead when it is at least this large, 0 always decodes the full image
+	bool buildIndex = false; // write a row index sidecar per input instead of converting it
+	bool rowBand = false; // convert only pixel rows firstRow to lastRow, through the row index
+	uint firstRow = 0;
+	uint lastRow = 0;
+	bool streamed = false; // decode rows as input chunks arrive instead of reading whole files first, "-" reads stdin
+	bool mjpeg = false; // decode every frame of a Motion JPEG stream and report the frame rate, "-" reads stdin
+	uint frameStep = 0; // with mjpeg, write every frameStep-th frame as a bitmap, 0 writes none
+	bool serve = false; // answer conversion requests from stdin, or socketPath when set, until shut down
+	std::string socketPath; // UNIX domain socket the server listens on
+	bool analyze = false; // print DC-only statistics (mean color, histogram, perceptual hash) instead of converting
+	bool conformance = false; // check every kernel against double precision references, input files serve as the corpus
+};
+
+#endif // DECODE_OPTIONS_H
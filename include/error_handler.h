@@ -9,7 +9,6 @@
 class ErrorHandler {
 public:
 	static void logJPEGError(const std::string&, bool&);
-	static void logJPEGError(const std::string&, bool&, std::ifstream&);
 };
 
 
@@ -0,0 +1,26 @@
+#ifndef FILE_IO_H
+#define FILE_IO_H
+
+#include <string>
+#include <vector>
+#include "utils.h"
+
+typedef unsigned long long uint64;
+
+const uint64 fnvOffsetBasis = 14695981039346656037ULL;
+
+// 64-bit FNV-1a, pass the previous result as hash to continue over another chunk
+uint64 hashBytes(const byte* const data, size_t length, uint64 hash = fnvOffsetBasis);
+
+// Reads a whole file into memory
+bool readFile(const std::string& filename, std::vector<byte>& data);
+// Reads a whole file into memory, hashing it (64-bit FNV-1a) in the same pass
+bool readFileHashed(const std::string& filename, std::vector<byte>& data, uint64& hash);
+// Reads length bytes starting at offset, fewer when the file ends first
+bool readFileRange(const std::string& filename, uint64 offset, uint64 length, std::vector<byte>& data);
+// Size in bytes and last modification time in seconds
+bool statFile(const std::string& filename, uint64& size, uint64& modifiedTime);
+// Creates a directory, succeeding as well when it already exists
+bool makeDirectory(const std::string& path);
+
+#endif // FILE_IO_H
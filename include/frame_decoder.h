@@ -0,0 +1,54 @@
+#ifndef FRAME_DECODER_H
+#define FRAME_DECODER_H
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include "jpeg.h"
+#include "thread_pool.h"
+
+// Decodes Motion JPEG, a stream of concatenated baseline frames, e.g. a camera recording or an MJPEG capture on stdin.
+// Frames are located by walking their marker segments up to SOS and then looking for EOI, so bytes between frames
+// (multipart boundaries and the like) are skipped. A frame whose DQT, DHT, SOF, DRI and SOS segments match the previous
+// one reuses its parsed tables and attached Huffman lookups, only the scan data is read again. MCU and scan data
+// buffers are kept across frames. Frames without DHT use the standard tables.
+class FrameDecoder {
+public:
+	// Frame number in the stream (failed frames count too), its header and its converted MCUs, valid only for the call
+	typedef std::function<void(uint, const JPEGImage*, const MCU*)> FrameCallback;
+
+	FrameDecoder(ThreadPool& pool, const FrameCallback& onFrame);
+	FrameDecoder(const FrameDecoder&) = delete;
+	FrameDecoder& operator=(const FrameDecoder&) = delete;
+
+	// Appends the next length bytes of the stream and decodes every frame completed by them
+	void push(const byte* const data, size_t length);
+	// Marks the end of the stream, a frame still missing its end is counted as failed
+	void finish();
+	// Decodes every frame of a stream held in memory as a whole
+	void decodeBuffer(const std::vector<byte>& data);
+	uint framesDecoded() const;
+	uint framesFailed() const;
+	uint headersReused() const;
+private:
+	enum class FrameScan { Complete, Incomplete, Malformed };
+
+	size_t decodeFrames(const std::vector<byte>& data, bool final);
+	FrameScan scanFrame(const std::vector<byte>& data, size_t start, size_t& scanStart, size_t& end);
+	bool decodeFrame(const std::vector<byte>& data, size_t start, size_t scanStart);
+
+	ThreadPool& pool;
+	FrameCallback onFrame;
+	std::unique_ptr<JPEGImage> jpeg; // header of the last frame, kept for reuse
+	std::vector<byte> headerKey; // table and frame segments jpeg was parsed from, empty after a failure
+	std::vector<byte> frameKey; // the same segments of the frame being located
+	std::vector<MCU> mcus;
+	std::vector<byte> buffer; // pushed bytes not yet part of a decoded frame
+	size_t searchFrom; // scan data of the frame at the front of the buffer already searched for EOI
+	uint frameCount;
+	uint decodedCount;
+	uint failedCount;
+	uint reusedCount;
+};
+
+#endif // FRAME_DECODER_H
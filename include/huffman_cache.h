@@ -0,0 +1,23 @@
+#ifndef HUFFMAN_CACHE_H
+#define HUFFMAN_CACHE_H
+
+#include <memory>
+#include "jpeg.h"
+
+const uint huffmanLookaheadBits = 9;
+
+// Decode structures built from one DHT, shared by every image that carries the same table
+struct HuffmanLookup {
+	byte offsets[17] = { 0 };
+	byte symbols[162] = { 0 };
+	uint codes[162] = { 0 };
+	// Indexed by the next huffmanLookaheadBits of the stream, a length of 0 means the code is longer than the lookahead
+	byte lookaheadSymbols[1 << huffmanLookaheadBits] = { 0 };
+	byte lookaheadLengths[1 << huffmanLookaheadBits] = { 0 };
+};
+
+// Returns the decode structures for table's counts and symbols, building them on the first request.
+// Safe to call from several threads, entries are kept for the lifetime of the process.
+std::shared_ptr<const HuffmanLookup> acquireHuffmanLookup(const HuffmanTable& table);
+
+#endif // HUFFMAN_CACHE_H
@@ -0,0 +1,56 @@
+#ifndef INCREMENTAL_DECODER_H
+#define INCREMENTAL_DECODER_H
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include "jpeg.h"
+#include "bit_reader.h"
+
+// Push based decoder for input that arrives in pieces, e.g. from a socket or a slow disk.
+// push() parses markers and decodes MCU rows as far as the bytes received so far allow, and hands each
+// finished row to the row callback right away. Between pushes only the bit position and DC predictors of
+// the next row are kept, entropy coded data that was already decoded is dropped as the scan goes on.
+class IncrementalDecoder {
+public:
+	// Called once the headers are parsed, before the first row. Returning false stops the decode.
+	typedef std::function<bool(const JPEGImage*)> HeaderCallback;
+	// MCU row index and its converted MCUs, valid only for the duration of the call
+	typedef std::function<void(uint, const MCU*)> RowCallback;
+
+	IncrementalDecoder(const HeaderCallback& onHeader, const RowCallback& onRow);
+	~IncrementalDecoder();
+	IncrementalDecoder(const IncrementalDecoder&) = delete;
+	IncrementalDecoder& operator=(const IncrementalDecoder&) = delete;
+
+	// Appends the next length bytes of the file, returns false once the input is known to be invalid
+	bool push(const byte* const data, size_t length);
+	// Marks the end of the input, returns true when every MCU row was decoded
+	bool finish();
+	bool failed() const;
+	uint rowsDecoded() const;
+private:
+	size_t headerEnd() const;
+	bool parseHeader();
+	bool unstuff(const byte* const data, size_t length);
+	bool decodeRows();
+	void discardDecodedData();
+	bool fail(const std::string& message);
+
+	HeaderCallback onHeader;
+	RowCallback onRow;
+	JPEGImage* jpeg;
+	std::vector<byte> header; // everything up to the end of the SOS segment, until it is complete
+	std::unique_ptr<BitReader> bitReader; // over jpeg->huffmanData
+	int prevDCCoefficients[3];
+	std::vector<MCU> row;
+	uint nextRow;
+	uint mcuRows;
+	uint mcuColumns;
+	bool markerPending; // the last scan byte received was 0xFF
+	bool scanComplete; // EOI seen or the input ended
+	bool hasFailed;
+	size_t retrySize; // entropy coded bytes to wait for before the next attempt at a row
+};
+
+#endif // INCREMENTAL_DECODER_H
@@ -0,0 +1,50 @@
+#ifndef PIXEL_BUFFER_H
+#define PIXEL_BUFFER_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include "jpeg.h"
+
+enum class PixelFormat {
+	Bitmap, // 24-bit BGR or 8-bit gray BMP file
+	BGRA32, // packed, alpha always 255
+	YCbCrPlanar // full resolution Y, Cb and Cr planes straight from the IDCT, no color conversion
+};
+
+// Decoded pixels in a raw layout chosen by the caller, in stored orientation.
+// Every row of every plane starts at an address that is a multiple of alignment, stride bytes after the one above it.
+// A stride of 0 packs rows as tightly as the alignment allows.
+class PixelBuffer {
+public:
+	PixelBuffer(PixelFormat format, uint width, uint height, size_t stride = 0, uint alignment = 1);
+	PixelBuffer(const PixelBuffer&) = delete;
+	PixelBuffer& operator=(const PixelBuffer&) = delete;
+
+	// False when the stride is shorter than a row or not a multiple of the alignment
+	bool isValid() const;
+	uint planes() const;
+	size_t stride() const;
+	byte* plane(uint index);
+	const byte* plane(uint index) const;
+	// Color converted MCUs for BGRA32, IDCT output that is not yet level shifted for YCbCrPlanar
+	void writeMCURow(uint mcuRow, const MCU* const rowMCUs);
+	// Reconstructed 0-255 gray samples, planar output gets neutral chroma planes
+	void writeMCURow(uint mcuRow, const GrayMCU* const rowMCUs);
+	// The planes one after another, stride padding included
+	bool save(const std::string& filename) const;
+private:
+	PixelFormat format;
+	uint width;
+	uint height;
+	uint bytesPerPixel;
+	size_t rowStride;
+	size_t planeSize;
+	std::vector<byte> storage; // over-allocated by the alignment, first points to the aligned start
+	byte* first;
+};
+
+// File extension of the output written in a format
+std::string pixelFormatExtension(PixelFormat format);
+
+#endif // PIXEL_BUFFER_H
@@ -0,0 +1,61 @@
+#ifndef READ_AHEAD_H
+#define READ_AHEAD_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include "file_io.h"
+#include "thread_pool.h"
+
+struct IoUringQueue;
+
+// Reads the files of a batch ahead of the decoder, keeping up to depth reads in flight within memoryCap bytes.
+// Reads go through io_uring on Linux when the kernel allows it, otherwise through a few reader threads.
+// A depth of 0 reads each file synchronously when it is requested.
+class ReadAhead {
+public:
+	ReadAhead(const std::vector<std::string>& files, uint depth, uint64 memoryCap, bool hashContent);
+	~ReadAhead();
+	ReadAhead(const ReadAhead&) = delete;
+	ReadAhead& operator=(const ReadAhead&) = delete;
+
+	// Blocks until the next file in order has been read, returns false once every file was handed out.
+	// hash is only filled in when hashContent was requested.
+	bool next(std::string& filename, std::vector<byte>& data, uint64& hash, bool& ok);
+	bool usingIoUring() const;
+private:
+	struct Request {
+		std::string filename;
+		std::vector<byte> data;
+		uint64 size = 0;
+		uint64 hash = 0;
+		bool done = false;
+		bool ok = false;
+		int fd = -1;
+		uint64 offset = 0; // bytes already read by io_uring
+	};
+
+	void issue();
+	void issueRequest(Request& request, size_t index);
+	void readRequest(Request& request);
+	void waitFor(Request& request);
+	bool submitRingRead(Request& request, size_t index);
+	void reapRingCompletion();
+
+	std::vector<Request> requests;
+	uint depth;
+	uint64 memoryCap;
+	bool hashContent;
+	size_t nextIndex; // next request handed to the caller
+	size_t issuedIndex; // requests below this were issued
+	uint64 outstandingBytes; // size of issued requests not yet handed to the caller
+
+	IoUringQueue* ring;
+	std::mutex mutex;
+	std::condition_variable readDone;
+	std::unique_ptr<ThreadPool> readers;
+};
+
+#endif // READ_AHEAD_H
@@ -0,0 +1,49 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <vector>
+#include <functional>
+#include "utils.h"
+
+enum class ResampleFilter {
+	Box,
+	Bilinear,
+	Lanczos
+};
+
+// Per output pixel contribution window of one axis, weights are padded to maxTaps per pixel
+struct ResampleTaps {
+	std::vector<uint> first;
+	std::vector<uint> count;
+	std::vector<float> weights;
+	uint maxTaps = 0;
+};
+
+// Separable resampler fed one source row at a time, top to bottom.
+// Rows are filtered horizontally as they arrive and kept in a ring just deep enough for the vertical filter,
+// so an output row is emitted as soon as the last source row it depends on was pushed.
+class Resampler {
+public:
+	typedef std::function<void(uint, const byte*)> RowCallback;
+
+	Resampler(uint width, uint height, uint targetWidth, uint targetHeight, uint channels, ResampleFilter filter);
+	// row holds width pixels of channels (1 or 3) interleaved bytes, emit(targetRow, pixels) receives every finished output row
+	void pushRow(const byte* const row, const RowCallback& emit);
+private:
+	void filterRow(const byte* const row, float* const out) const;
+
+	uint width;
+	uint height;
+	uint targetWidth;
+	uint targetHeight;
+	uint channels;
+	ResampleTaps horizontal;
+	ResampleTaps vertical;
+	std::vector<float> ring; // vertical.maxTaps horizontally filtered rows, indexed by source row modulo the ring size
+	std::vector<float> accumulator;
+	std::vector<byte> output;
+	uint rowsPushed;
+	uint rowsEmitted;
+};
+
+#endif // RESAMPLER_H
@@ -0,0 +1,45 @@
+#ifndef ROW_INDEX_H
+#define ROW_INDEX_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include "jpeg.h"
+#include "file_io.h"
+
+// Where the entropy coded data of one MCU row starts in the file, and the decoder state at that point
+struct RowCheckpoint {
+	uint64 offset = 0; // file offset of the byte holding the row's first bit
+	byte bit = 0; // bit within that byte, counted from the most significant
+	int prevDCCoefficients[3] = { 0 };
+};
+
+// Random access to the MCU rows of a baseline JPEG.
+// build() entropy decodes the file once and records a checkpoint at the start of every MCU row, with or without
+// restart markers. decodeRows() then reads and decodes only the span of the file a band of rows covers.
+// The index is kept as a small binary sidecar next to the image and is stale once the image changes.
+class RowIndex {
+public:
+	// Called with the parsed headers before the first row, returning false stops the decode
+	typedef std::function<bool(const JPEGImage*)> HeaderCallback;
+	// MCU row index and its converted MCUs, valid only for the duration of the call
+	typedef std::function<void(uint, const MCU*)> RowCallback;
+
+	bool build(const std::string& filename);
+	// False when the sidecar is missing or malformed, or filename changed size or modification time since it was built
+	bool load(const std::string& path, const std::string& filename);
+	bool save(const std::string& path) const;
+	uint rows() const; // MCU rows
+	// Decodes MCU rows [firstRow, firstRow + count) of filename
+	bool decodeRows(const std::string& filename, uint firstRow, uint count, const HeaderCallback& onHeader, const RowCallback& onRow) const;
+private:
+	uint64 sourceSize = 0;
+	uint64 sourceModifiedTime = 0;
+	uint64 headerHash = 0; // of every byte before the scan data
+	uint64 scanOffset = 0; // file offset of the first entropy coded byte
+	uint mcuRows = 0;
+	uint mcuColumns = 0;
+	std::vector<RowCheckpoint> checkpoints; // one per MCU row, then one for the end of the scan
+};
+
+#endif // ROW_INDEX_H
@@ -0,0 +1,40 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include "utils.h"
+
+class ThreadPool {
+public:
+	// threadCount of 0 uses the hardware concurrency, 1 keeps all work on the calling thread
+	ThreadPool(uint threadCount, uint serialThreshold);
+	~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	void submit(const std::function<void()>& task);
+	// Splits [0, count) into one contiguous chunk per thread and blocks until all chunks ran.
+	// Counts below the serial threshold run directly on the calling thread.
+	void parallelFor(uint count, const std::function<void(uint, uint)>& task);
+	// Runs task(i) for every i in [0, count) as its own unit of work, regardless of the serial threshold
+	void forEachIndex(uint count, const std::function<void(uint)>& task);
+	uint size() const;
+private:
+	void runTasks(uint count, const std::function<void(uint)>& task);
+	bool runPendingTask();
+	void workerLoop();
+
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> tasks;
+	std::mutex mutex;
+	std::condition_variable taskAvailable;
+	bool stopping;
+	uint serialThreshold;
+};
+
+#endif // THREAD_POOL_H
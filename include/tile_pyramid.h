@@ -0,0 +1,50 @@
+#ifndef TILE_PYRAMID_H
+#define TILE_PYRAMID_H
+
+#include <string>
+#include <vector>
+#include "jpeg.h"
+
+// Builds a tile pyramid from one top to bottom pass over the image.
+// Level 0 is the full resolution, every further level halves both sides with a 2x2 box filter until the image fits a
+// single tile. Each level keeps one band of tileSize rows and the row waiting for its pair, tiles are written as
+// tileSize x tileSize BMPs, smaller at the right and bottom edges, to directory/<level>/<column>_<row>.bmp as soon as
+// their band is complete.
+class TilePyramid {
+public:
+	// channels is 3 for RGB or 1 for gray, directory has to exist
+	TilePyramid(const std::string& directory, uint width, uint height, uint channels, uint tileSize);
+	TilePyramid(const TilePyramid&) = delete;
+	TilePyramid& operator=(const TilePyramid&) = delete;
+
+	// MCU rows in order, RGB for 3 channels and Y for 1
+	void writeMCURow(uint mcuRow, const MCU* const rowMCUs);
+	// One full resolution row of width pixels, rows in order
+	void pushRow(const byte* const pixels);
+	uint levels() const;
+	uint tilesWritten() const;
+	bool failed() const; // a level directory or tile could not be written
+private:
+	struct Level {
+		uint width = 0;
+		uint height = 0;
+		uint rowsReceived = 0;
+		std::vector<byte> band; // tileSize rows
+		std::vector<byte> pending; // even row of the next pair for the level below
+		std::vector<byte> reduced; // row handed to the level below
+		bool hasPending = false;
+	};
+
+	void pushRow(uint level, const byte* const pixels);
+	void writeTiles(uint level, uint tileRow, uint rows);
+
+	std::string directory;
+	uint channels;
+	uint tileSize;
+	std::vector<Level> pyramid;
+	std::vector<byte> row; // full resolution row assembled from MCUs
+	uint tileCount;
+	bool hasFailed;
+};
+
+#endif // TILE_PYRAMID_H
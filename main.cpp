@@ -1,59 +1,1212 @@
 #include "include/jpeg.h"
+#include "include/decode_options.h"
+#include "include/thread_pool.h"
+#include "include/bitmap_encoder.h"
+#include "include/batch_manifest.h"
+#include "include/file_io.h"
+#include "include/read_ahead.h"
+#include "include/incremental_decoder.h"
+#include "include/row_index.h"
+#include "include/analytics.h"
+#include "include/batch_scheduler.h"
+#include "include/tile_pyramid.h"
+#include "include/frame_decoder.h"
 #include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <functional>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <chrono>
 
 struct JPEGImage;
-JPEGImage* parseJPEG(const std::string&);
+JPEGImage* parseJPEG(const std::vector<byte>&);
 void printjpeg(const JPEGImage* const);
 MCU* decodeHuffmanData(JPEGImage* const);
+MCU* decodeHuffmanDataSpeculative(JPEGImage* const, ThreadPool&);
+CoefficientImage* decodeCoefficients(JPEGImage* const, const bool);
+void writeCoefficients(const std::string&, const CoefficientImage* const);
+bool quantizationTablesMatch(const JPEGImage* const, const uint);
+CoefficientImage* forwardTransform(const MCU* const, const JPEGImage* const, const uint, ThreadPool* const);
+bool encodeCoefficients(const std::string&, const CoefficientImage* const, const bool, const uint);
 void writeBMP(const std::string&, const MCU* const, const JPEGImage*);
-void dequantize(const JPEGImage* const, MCU* const);
-void inverseDCT(const JPEGImage* const, MCU* const);
-void convertToRGB(const JPEGImage*, MCU* const);
+void writeGrayscaleBMP(const std::string&, const GrayMCU* const, const JPEGImage*);
+void writePGM(const std::string&, const GrayMCU* const, const JPEGImage*);
+GrayMCU* decodeGrayscaleData(JPEGImage* const);
+void reconstructGrayscale(const JPEGImage* const, GrayMCU* const, ThreadPool* const, const uint);
+void dequantize(const JPEGImage* const, MCU* const, ThreadPool* const);
+void inverseDCT(const JPEGImage* const, MCU* const, ThreadPool* const, const uint);
+void convertToRGB(const JPEGImage*, MCU* const, ThreadPool* const);
+bool decodePipelined(JPEGImage* const, ThreadPool&, uint, const uint, const std::function<void(uint, const MCU*)>&);
+bool probeFrame(const std::string&, uint&, uint&, uint&);
+bool runConformance(const std::vector<std::string>&, ThreadPool&);
+void serveStdin(const std::function<std::string(const std::string&)>&);
+bool serveSocket(const std::string&, const std::function<std::string(const std::string&)>&);
 
-int main(int argc, char** argv) {
-	if (argc < 2) {
-		std::cout << "Error: No file specified for conversion\n";
-		return 0;
-	}
+// Bytes read per push when streaming, small enough for the first rows to come out before the file is read
+const size_t streamChunkSize = 16 * 1024;
+// Later inputs that may start ahead of one waiting for memory, per scheduler slot
+const uint scheduleBypassPerSlot = 2;
 
+// Splits the command line into decode options and input files, returns false on a malformed option
+bool parseOptions(int argc, char** argv, DecodeOptions& options, std::vector<std::string>& files) {
 	for (int i = 1; i < argc; ++i) {
-		const std::string filename(argv[i]);
+		const std::string arg(argv[i]);
+		if (arg == "--pipeline") {
+			options.pipelined = true;
+		}
+		else if (arg == "--speculative") {
+			options.speculative = true;
+		}
+		else if (arg == "--coefficients") {
+			options.coefficientsOnly = true;
+		}
+		else if (arg == "--zigzag") {
+			options.zigZagOrder = true;
+		}
+		else if (arg == "--jpeg") {
+			options.outputJPEG = true;
+		}
+		else if (arg == "--optimize-huffman") {
+			options.optimizeHuffman = true;
+		}
+		else if (arg == "--pgm") {
+			options.outputPGM = true;
+		}
+		else if (arg == "--ignore-orientation") {
+			options.applyOrientation = false;
+		}
+		else if (arg == "--incremental") {
+			options.incremental = true;
+		}
+		else if (arg == "--pyramid") {
+			options.pyramid = true;
+		}
+		else if (arg == "--analyze") {
+			options.analyze = true;
+		}
+		else if (arg == "--conformance") {
+			options.conformance = true;
+		}
+		else if (arg == "--build-index") {
+			options.buildIndex = true;
+		}
+		else if (arg == "--stream") {
+			options.streamed = true;
+		}
+		else if (arg == "--mjpeg") {
+			options.mjpeg = true;
+		}
+		else if (arg == "--serve") {
+			options.serve = true;
+		}
+		else if (arg == "--resize" || arg == "--filter" || arg == "--rows") {
+			if (i + 1 >= argc) {
+				std::cout << "Error: Option " + arg + " expects a value\n";
+				return false;
+			}
+			const std::string value(argv[++i]);
+			if (arg == "--rows") {
+				// FIRST-LAST, inclusive pixel rows in stored orientation
+				char* end = nullptr;
+				options.firstRow = (uint)std::strtoul(value.c_str(), &end, 10);
+				if (*end != '-') {
+					std::cout << "Error: --rows expects FIRST-LAST\n";
+					return false;
+				}
+				options.lastRow = (uint)std::strtoul(end + 1, nullptr, 10);
+				options.rowBand = true;
+				if (options.lastRow < options.firstRow) {
+					std::cout << "Error: --rows expects FIRST-LAST with FIRST <= LAST\n";
+					return false;
+				}
+			}
+			else if (arg == "--resize") {
+				// WxH, either side may be 0 to keep the aspect ratio
+				char* end = nullptr;
+				options.resizeWidth = (uint)std::strtoul(value.c_str(), &end, 10);
+				if (*end != 'x') {
+					std::cout << "Error: --resize expects WIDTHxHEIGHT\n";
+					return false;
+				}
+				options.resizeHeight = (uint)std::strtoul(end + 1, nullptr, 10);
+			}
+			else if (value == "box") {
+				options.filter = ResampleFilter::Box;
+			}
+			else if (value == "bilinear") {
+				options.filter = ResampleFilter::Bilinear;
+			}
+			else if (value == "lanczos") {
+				options.filter = ResampleFilter::Lanczos;
+			}
+			else {
+				std::cout << "Error: --filter expects box, bilinear or lanczos\n";
+				return false;
+			}
+		}
+		else if (arg == "--manifest" || arg == "--cache-key" || arg == "--socket" || arg == "--format" || arg == "--transform" || arg == "--crop") {
+			if (i + 1 >= argc) {
+				std::cout << "Error: Option " + arg + " expects a value\n";
+				return false;
+			}
+			const std::string value(argv[++i]);
+			if (arg == "--manifest") {
+				options.manifestPath = value;
+			}
+			else if (arg == "--socket") {
+				options.serve = true;
+				options.socketPath = value;
+			}
+			else if (arg == "--transform") {
+				const char* const names[] = { "none", "auto", "flip-h", "flip-v", "rot90", "rot180", "rot270", "transpose", "transverse" };
+				const char* const* const name = std::find(names, names + 9, value);
+				if (name == names + 9) {
+					std::cout << "Error: --transform expects auto, flip-h, flip-v, rot90, rot180, rot270, transpose or transverse\n";
+					return false;
+				}
+				options.transform = (LosslessTransform)(name - names);
+			}
+			else if (arg == "--crop") {
+				// WxH+X+Y in pixels of the transformed image
+				char* end = nullptr;
+				options.crop.width = (uint)std::strtoul(value.c_str(), &end, 10);
+				if (*end == 'x') {
+					options.crop.height = (uint)std::strtoul(end + 1, &end, 10);
+				}
+				if (*end == '+') {
+					options.crop.x = (uint)std::strtoul(end + 1, &end, 10);
+				}
+				if (*end == '+') {
+					options.crop.y = (uint)std::strtoul(end + 1, &end, 10);
+				}
+				if (*end != '\0' || options.crop.width == 0 || options.crop.height == 0) {
+					std::cout << "Error: --crop expects WIDTHxHEIGHT+X+Y\n";
+					return false;
+				}
+			}
+			else if (arg == "--format") {
+				if (value == "bmp") {
+					options.pixelFormat = PixelFormat::Bitmap;
+				}
+				else if (value == "bgra") {
+					options.pixelFormat = PixelFormat::BGRA32;
+				}
+				else if (value == "yuv444p") {
+					options.pixelFormat = PixelFormat::YCbCrPlanar;
+				}
+				else {
+					std::cout << "Error: --format expects bmp, bgra or yuv444p\n";
+					return false;
+				}
+			}
+			else if (value == "content" || value == "mtime") {
+				options.cacheByContent = (value == "content");
+			}
+			else {
+				std::cout << "Error: --cache-key expects content or mtime\n";
+				return false;
+			}
+		}
+		else if (arg == "--threads" || arg == "--serial-threshold" || arg == "--ring-rows" || arg == "--quality" || arg == "--restart-interval" ||
+			arg == "--read-ahead" || arg == "--read-ahead-memory" || arg == "--thumbnail" || arg == "--max-edge" || arg == "--stride" || arg == "--align" ||
+			arg == "--memory-budget" || arg == "--tile-size" || arg == "--frame-step") {
+			if (i + 1 >= argc) {
+				std::cout << "Error: Option " + arg + " expects a value\n";
+				return false;
+			}
+			const uint value = (uint)std::strtoul(argv[++i], nullptr, 10);
+			if (arg == "--threads") {
+				options.threadCount = value;
+			}
+			else if (arg == "--serial-threshold") {
+				options.serialThreshold = value;
+			}
+			else if (arg == "--ring-rows") {
+				options.ringRows = value;
+			}
+			else if (arg == "--quality") {
+				options.quality = value;
+			}
+			else if (arg == "--restart-interval") {
+				options.restartInterval = value;
+			}
+			else if (arg == "--read-ahead") {
+				options.readAheadDepth = value;
+			}
+			else if (arg == "--thumbnail") {
+				options.thumbnailSize = value;
+			}
+			else if (arg == "--max-edge") {
+				options.maxEdge = value;
+			}
+			else if (arg == "--stride") {
+				options.stride = value;
+			}
+			else if (arg == "--align") {
+				options.rowAlignment = value;
+			}
+			else if (arg == "--memory-budget") {
+				options.memoryBudgetMB = value;
+			}
+			else if (arg == "--tile-size") {
+				options.tileSize = value;
+			}
+			else if (arg == "--frame-step") {
+				options.frameStep = value;
+			}
+			else {
+				options.readAheadMemoryMB = value;
+			}
+		}
+		else if (arg.rfind("--", 0) == 0) {
+			std::cout << "Error: Unknown option " + arg + "\n";
+			return false;
+		}
+		else {
+			files.push_back(arg);
+		}
+	}
+	const bool resizing = options.maxEdge != 0 || options.resizeWidth != 0 || options.resizeHeight != 0;
+	if (resizing && (options.outputJPEG || options.coefficientsOnly)) {
+		std::cout << "Error: Resizing applies to bitmap and PGM output only\n";
+		return false;
+	}
+	if (options.rowBand && (resizing || options.outputJPEG || options.coefficientsOnly || options.outputPGM || options.thumbnailSize != 0 ||
+		options.streamed)) {
+		std::cout << "Error: --rows writes bitmap bands only\n";
+		return false;
+	}
+	if (options.streamed && (resizing || options.outputJPEG || options.coefficientsOnly || options.outputPGM || options.thumbnailSize != 0 ||
+		options.incremental)) {
+		std::cout << "Error: --stream writes full size bitmaps only\n";
+		return false;
+	}
+	if (options.pixelFormat != PixelFormat::Bitmap && (resizing || options.outputJPEG || options.coefficientsOnly || options.outputPGM ||
+		options.streamed || options.rowBand)) {
+		std::cout << "Error: --format applies to full size pixel output only\n";
+		return false;
+	}
+	if (options.rowAlignment == 0 || (options.rowAlignment & (options.rowAlignment - 1)) != 0) {
+		std::cout << "Error: --align expects a power of two\n";
+		return false;
+	}
+	const bool lossless = options.transform != LosslessTransform::None || options.crop.width != 0;
+	if (lossless && (resizing || options.coefficientsOnly || options.outputPGM || options.quality != 0 || options.pixelFormat != PixelFormat::Bitmap ||
+		options.streamed || options.rowBand || options.analyze)) {
+		std::cout << "Error: --transform and --crop write JPEGs with the source quantization tables only\n";
+		return false;
+	}
+	if (lossless) {
+		options.outputJPEG = true;
+	}
+	if (options.pyramid && (resizing || options.outputJPEG || options.coefficientsOnly || options.outputPGM ||
+		options.pixelFormat != PixelFormat::Bitmap || options.streamed || options.rowBand || options.analyze || options.tileSize == 0)) {
+		std::cout << "Error: --pyramid writes full size bitmap tiles only\n";
+		return false;
+	}
+	if (options.memoryBudgetMB != 0 && (options.streamed || options.rowBand)) {
+		std::cout << "Error: --memory-budget applies to batch conversion only\n";
+		return false;
+	}
+	if (options.analyze && (resizing || options.outputJPEG || options.coefficientsOnly || options.outputPGM || options.thumbnailSize != 0 ||
+		options.streamed || options.rowBand || options.incremental)) {
+		std::cout << "Error: --analyze writes no output files\n";
+		return false;
+	}
+	if (options.mjpeg && (resizing || options.outputJPEG || options.coefficientsOnly || options.outputPGM || options.thumbnailSize != 0 ||
+		options.pixelFormat != PixelFormat::Bitmap || options.streamed || options.rowBand || options.analyze || options.pyramid ||
+		options.incremental || options.memoryBudgetMB != 0)) {
+		std::cout << "Error: --mjpeg writes full size bitmap frames only\n";
+		return false;
+	}
+	return true;
+}
+
+// Output affecting options, a manifest entry recorded under a different key is stale
+std::string outputOptionsKey(const DecodeOptions& options) {
+	std::string key;
+	if (options.coefficientsOnly) {
+		key += options.zigZagOrder ? "coef-zigzag" : "coef";
+	}
+	else if (options.outputJPEG) {
+		key += "jpeg-q" + std::to_string(options.quality) + "-rst" + std::to_string(options.restartInterval);
+		key += options.optimizeHuffman ? "-opt" : "";
+		if (options.transform != LosslessTransform::None) {
+			key += "-xform" + std::to_string((int)options.transform);
+		}
+		if (options.crop.width != 0) {
+			key += "-crop" + std::to_string(options.crop.width) + "x" + std::to_string(options.crop.height) + "+" +
+				std::to_string(options.crop.x) + "+" + std::to_string(options.crop.y);
+		}
+	}
+	else {
+		key += options.outputPGM ? "pgm" : "bmp";
+	}
+	if (!options.applyOrientation) {
+		key += "-upright";
+	}
+	if (options.maxEdge != 0 || options.resizeWidth != 0 || options.resizeHeight != 0) {
+		const char* const filters[] = { "box", "bilinear", "lanczos" };
+		key += "-resize" + std::to_string(options.resizeWidth) + "x" + std::to_string(options.resizeHeight) + "-edge" + std::to_string(options.maxEdge);
+		key += std::string("-") + filters[(int)options.filter];
+	}
+	if (options.thumbnailSize != 0) {
+		key += "-thumb" + std::to_string(options.thumbnailSize);
+	}
+	if (options.pixelFormat != PixelFormat::Bitmap) {
+		key += (options.pixelFormat == PixelFormat::BGRA32 ? "-bgra" : "-yuv444p");
+		key += "-stride" + std::to_string(options.stride) + "-align" + std::to_string(options.rowAlignment);
+	}
+	if (options.pyramid) {
+		key += "-pyramid" + std::to_string(options.tileSize);
+	}
+	if (options.rowBand) {
+		key += "-rows" + std::to_string(options.firstRow) + "-" + std::to_string(options.lastRow);
+	}
+	return key;
+}
 
-		// read jpeg
-		JPEGImage* jpeg = parseJPEG(filename);
+// Parses the EXIF thumbnail of jpeg when it is a valid JPEG at least size pixels on its long side.
+// Returns nullptr when the full image has to be decoded instead.
+JPEGImage* parseThumbnail(const JPEGImage* const jpeg, const uint size) {
+	if (jpeg->exif.thumbnail.empty()) {
+		return nullptr;
+	}
+	JPEGImage* thumbnail = parseJPEG(jpeg->exif.thumbnail);
+	if (thumbnail != nullptr && (!thumbnail->isValid || (thumbnail->width < size && thumbnail->height < size))) {
+		delete thumbnail;
+		return nullptr;
+	}
+	return thumbnail;
+}
 
-		// validate jpeg
-		if (jpeg == nullptr) { 
-			continue;
+// Output size in stored orientation, false when the output keeps the source size.
+// The requested size refers to the image as displayed, so it is swapped back for the transposing orientations.
+bool resizeTarget(const JPEGImage* const jpeg, const DecodeOptions& options, uint& targetWidth, uint& targetHeight) {
+	if (options.maxEdge == 0 && options.resizeWidth == 0 && options.resizeHeight == 0) {
+		return false;
+	}
+	const bool transposed = jpeg->exif.orientation >= 5;
+	const uint width = transposed ? jpeg->height : jpeg->width;
+	const uint height = transposed ? jpeg->width : jpeg->height;
+	uint displayWidth = options.resizeWidth;
+	uint displayHeight = options.resizeHeight;
+	if (options.maxEdge != 0) {
+		displayWidth = (width >= height) ? options.maxEdge : 0;
+		displayHeight = (width >= height) ? 0 : options.maxEdge;
+	}
+	if (displayWidth == 0) {
+		displayWidth = (uint)(((unsigned long long)width * displayHeight + height / 2) / height);
+	}
+	if (displayHeight == 0) {
+		displayHeight = (uint)(((unsigned long long)height * displayWidth + width / 2) / width);
+	}
+	displayWidth = (displayWidth == 0) ? 1 : displayWidth;
+	displayHeight = (displayHeight == 0) ? 1 : displayHeight;
+	targetWidth = transposed ? displayHeight : displayWidth;
+	targetHeight = transposed ? displayWidth : displayHeight;
+	return true;
+}
+
+// Smallest pixel block the scaled IDCT can shrink each 8x8 block to while the image stays at least the target size
+uint reducedBlockSize(const JPEGImage* const jpeg, uint targetWidth, uint targetHeight) {
+	for (uint blockSize = 1; blockSize < 8; blockSize *= 2) {
+		const uint factor = 8 / blockSize;
+		if ((jpeg->width + factor - 1) / factor >= targetWidth && (jpeg->height + factor - 1) / factor >= targetHeight) {
+			return blockSize;
 		}
-		else if (jpeg->isValid == false)
-		{
-			std::cout << "Error: Provided file " + filename + " is an invalid JPEG\n";
-			delete jpeg;
-			continue;
+	}
+	return 8;
+}
+
+// Decodes at the nearest DCT scale above the target size and resamples the rest of the way as rows finish
+std::string convertResized(JPEGImage* const jpeg, const std::string& baseName, const DecodeOptions& options, ThreadPool& pool,
+	uint targetWidth, uint targetHeight) {
+	const uint blockSize = reducedBlockSize(jpeg, targetWidth, targetHeight);
+	const uint factor = 8 / blockSize;
+	const uint width = (jpeg->width + factor - 1) / factor;
+	const uint height = (jpeg->height + factor - 1) / factor;
+	const uint mcuRows = (jpeg->height + 7) / 8;
+	const uint mcuCols = (jpeg->width + 7) / 8;
+
+	if (jpeg->numComponents == 1) {
+		GrayMCU* blocks = decodeGrayscaleData(jpeg);
+		if (blocks == nullptr) {
+			return "";
+		}
+		reconstructGrayscale(jpeg, blocks, &pool, blockSize);
+		const std::string outName = baseName + (options.outputPGM ? ".pgm" : ".bmp");
+		if (options.outputPGM) {
+			std::vector<byte> pixels((size_t)targetWidth * targetHeight);
+			ResizingRowWriter resizer(width, height, blockSize, targetWidth, targetHeight, 1, options.filter,
+				[&pixels, targetWidth](uint row, const byte* const rowPixels) {
+					std::copy(rowPixels, rowPixels + targetWidth, pixels.begin() + (size_t)row * targetWidth);
+				});
+			for (uint i = 0; i < mcuRows; ++i) {
+				resizer.writeMCURow(i, blocks + i * mcuCols);
+			}
+			writePGMPixels(outName, pixels.data(), targetWidth, targetHeight, jpeg->exif.orientation);
+		}
+		else {
+			BitmapRowWriter writer(outName, targetWidth, targetHeight, 8, jpeg->exif.orientation);
+			ResizingRowWriter resizer(width, height, blockSize, targetWidth, targetHeight, 1, options.filter,
+				[&writer](uint row, const byte* const rowPixels) { writer.writeRow(row, rowPixels); });
+			for (uint i = 0; i < mcuRows && writer.isOpen(); ++i) {
+				resizer.writeMCURow(i, blocks + i * mcuCols);
+			}
 		}
+		delete[] blocks;
+		return outName;
+	}
+
+	const std::string outName = baseName + ".bmp";
+	BitmapRowWriter writer(outName, targetWidth, targetHeight, 24, jpeg->exif.orientation);
+	if (!writer.isOpen()) {
+		return "";
+	}
+	ResizingRowWriter resizer(width, height, blockSize, targetWidth, targetHeight, 3, options.filter,
+		[&writer](uint row, const byte* const rowPixels) { writer.writeRow(row, rowPixels); });
+	if (options.pipelined) {
+		const auto writeRow = [&resizer](uint row, const MCU* const rowMCUs) { resizer.writeMCURow(row, rowMCUs); };
+		if (!decodePipelined(jpeg, pool, options.ringRows, blockSize, writeRow)) {
+			std::cout << "Error: Pipelined decode of " + baseName + " failed\n";
+			writer.discard();
+			return "";
+		}
+		return outName;
+	}
 
-		printjpeg(jpeg);
-		// decode Huffman data
-		MCU* mcus = decodeHuffmanData(jpeg);
+	MCU* mcus = options.speculative ? decodeHuffmanDataSpeculative(jpeg, pool) : decodeHuffmanData(jpeg);
+	if (mcus == nullptr) {
+		std::cout << "MCU Array Deleted\n";
+		writer.discard();
+		return "";
+	}
+	dequantize(jpeg, mcus, &pool);
+	inverseDCT(jpeg, mcus, &pool, blockSize);
+	convertToRGB(jpeg, mcus, &pool);
+	for (uint i = 0; i < mcuRows; ++i) {
+		resizer.writeMCURow(i, mcus + i * mcuCols);
+	}
+	delete[] mcus;
+	return outName;
+}
+
+// Decodes into a raw BGRA32 or planar YCbCr buffer laid out as options ask and writes it out as is.
+// Planar output is taken from the IDCT before color conversion, so that pass never runs.
+std::string convertToPixelBuffer(JPEGImage* const jpeg, const std::string& baseName, const DecodeOptions& options, ThreadPool& pool) {
+	PixelBuffer buffer(options.pixelFormat, jpeg->width, jpeg->height, options.stride, options.rowAlignment);
+	if (!buffer.isValid()) {
+		return "";
+	}
+	const uint mcuRows = (jpeg->height + 7) / 8;
+	const uint mcuCols = (jpeg->width + 7) / 8;
+	if (jpeg->numComponents == 1) {
+		GrayMCU* blocks = decodeGrayscaleData(jpeg);
+		if (blocks == nullptr) {
+			return "";
+		}
+		reconstructGrayscale(jpeg, blocks, &pool, 8);
+		for (uint i = 0; i < mcuRows; ++i) {
+			buffer.writeMCURow(i, blocks + i * mcuCols);
+		}
+		delete[] blocks;
+	}
+	else if (options.pipelined && options.pixelFormat == PixelFormat::BGRA32) {
+		const auto writeRow = [&buffer](uint row, const MCU* const rowMCUs) { buffer.writeMCURow(row, rowMCUs); };
+		if (!decodePipelined(jpeg, pool, options.ringRows, 8, writeRow)) {
+			std::cout << "Error: Pipelined decode of " + baseName + " failed\n";
+			return "";
+		}
+	}
+	else {
+		MCU* mcus = options.speculative ? decodeHuffmanDataSpeculative(jpeg, pool) : decodeHuffmanData(jpeg);
 		if (mcus == nullptr) {
 			std::cout << "MCU Array Deleted\n";
-			delete jpeg;
-			continue;
+			return "";
+		}
+		dequantize(jpeg, mcus, &pool);
+		inverseDCT(jpeg, mcus, &pool, 8);
+		if (options.pixelFormat == PixelFormat::BGRA32) {
+			convertToRGB(jpeg, mcus, &pool);
 		}
+		for (uint i = 0; i < mcuRows; ++i) {
+			buffer.writeMCURow(i, mcus + i * mcuCols);
+		}
+		delete[] mcus;
+	}
+	const std::string outName = baseName + pixelFormatExtension(options.pixelFormat);
+	if (!buffer.save(outName)) {
+		return "";
+	}
+	std::cout << "Wrote " + std::to_string(jpeg->width) + "x" + std::to_string(jpeg->height) + " " + std::to_string(buffer.planes()) +
+		" plane(s) with a stride of " + std::to_string(buffer.stride()) + " bytes to " + outName + "\n";
+	return outName;
+}
 
-		dequantize(jpeg, mcus);
+// Feeds MCU rows from the pipelined decoder straight into a tile pyramid, so neither the full image nor any level
+// is ever held in memory as a whole. Returns the directory the levels were written to.
+std::string convertPyramid(JPEGImage* const jpeg, const std::string& baseName, const DecodeOptions& options, ThreadPool& pool) {
+	const std::string directory = baseName + "_tiles";
+	if (!makeDirectory(directory)) {
+		std::cout << "Error: Could not create directory " + directory + "\n";
+		return "";
+	}
+	TilePyramid pyramid(directory, jpeg->width, jpeg->height, (jpeg->numComponents == 1) ? 1 : 3, options.tileSize);
+	if (pyramid.failed()) {
+		return "";
+	}
+	const auto writeRow = [&pyramid](uint row, const MCU* const rowMCUs) { pyramid.writeMCURow(row, rowMCUs); };
+	if (!decodePipelined(jpeg, pool, options.ringRows, 8, writeRow)) {
+		std::cout << "Error: Pipelined decode of " + baseName + " failed\n";
+		return "";
+	}
+	if (pyramid.failed()) {
+		std::cout << "Error: Could not write every tile of " + baseName + "\n";
+		return "";
+	}
+	std::cout << "Wrote " + std::to_string(pyramid.tilesWritten()) + " tiles in " + std::to_string(pyramid.levels()) + " levels to " + directory + "\n";
+	return directory;
+}
+
+// Runs the decode path selected by options and writes the result next to baseName.
+// Returns the output file name, or an empty string when decoding failed.
+std::string convertJPEG(JPEGImage* const jpeg, const std::string& baseName, const DecodeOptions& options, ThreadPool& pool) {
+	if (options.coefficientsOnly) {
+		CoefficientImage* coefficients = decodeCoefficients(jpeg, options.zigZagOrder);
+		if (coefficients == nullptr) {
+			return "";
+		}
+		writeCoefficients(baseName + ".coef", coefficients);
+		delete coefficients;
+		return baseName + ".coef";
+	}
+
+	// Rotations, mirrors and block aligned crops rearrange the coefficients, nothing is dequantized
+	if (options.transform != LosslessTransform::None || options.crop.width != 0) {
+		CoefficientImage* coefficients = decodeCoefficients(jpeg, false);
+		if (coefficients == nullptr) {
+			return "";
+		}
+		const LosslessTransform transform = (options.transform == LosslessTransform::Auto) ?
+			transformForOrientation(jpeg->exif.orientation) : options.transform;
+		CoefficientImage* transformed = transformCoefficients(coefficients, transform, options.crop);
+		delete coefficients;
+		if (transformed == nullptr) {
+			return "";
+		}
+		const bool encoded = encodeCoefficients(baseName + ".out.jpg", transformed, options.optimizeHuffman, options.restartInterval);
+		delete transformed;
+		return encoded ? baseName + ".out.jpg" : "";
+	}
+
+	// Unchanged quantization tables mean the coefficients can be re-encoded without a round trip through pixels
+	if (options.outputJPEG && (options.quality == 0 || quantizationTablesMatch(jpeg, options.quality))) {
+		CoefficientImage* coefficients = decodeCoefficients(jpeg, false);
+		if (coefficients == nullptr) {
+			return "";
+		}
+		const bool encoded = encodeCoefficients(baseName + ".out.jpg", coefficients, options.optimizeHuffman, options.restartInterval);
+		delete coefficients;
+		return encoded ? baseName + ".out.jpg" : "";
+	}
+
+	uint targetWidth = 0;
+	uint targetHeight = 0;
+	if (resizeTarget(jpeg, options, targetWidth, targetHeight)) {
+		return convertResized(jpeg, baseName, options, pool, targetWidth, targetHeight);
+	}
+	if (options.pixelFormat != PixelFormat::Bitmap) {
+		return convertToPixelBuffer(jpeg, baseName, options, pool);
+	}
+	if (options.pyramid) {
+		return convertPyramid(jpeg, baseName, options, pool);
+	}
+
+	// Single component images never need chroma planes or color conversion
+	if (jpeg->numComponents == 1 && !options.outputJPEG) {
+		GrayMCU* blocks = decodeGrayscaleData(jpeg);
+		if (blocks == nullptr) {
+			return "";
+		}
+		reconstructGrayscale(jpeg, blocks, &pool, 8);
+		const std::string outName = baseName + (options.outputPGM ? ".pgm" : ".bmp");
+		if (options.outputPGM) {
+			writePGM(outName, blocks, jpeg);
+		}
+		else {
+			writeGrayscaleBMP(outName, blocks, jpeg);
+		}
+		delete[] blocks;
+		return outName;
+	}
+
+	const std::string outName = baseName + (options.outputJPEG ? ".out.jpg" : ".bmp");
+	if (options.pipelined && !options.outputJPEG) {
+		BitmapRowWriter writer(outName, jpeg->width, jpeg->height, 24, jpeg->exif.orientation);
+		if (!writer.isOpen()) {
+			return "";
+		}
+		const auto writeRow = [&writer](uint row, const MCU* const rowMCUs) { writer.writeMCURow(row, rowMCUs); };
+		if (!decodePipelined(jpeg, pool, options.ringRows, 8, writeRow)) {
+			std::cout << "Error: Pipelined decode of " + baseName + " failed\n";
+			writer.discard();
+			return "";
+		}
+		return outName;
+	}
+
+	// decode Huffman data
+	MCU* mcus = options.speculative ? decodeHuffmanDataSpeculative(jpeg, pool) : decodeHuffmanData(jpeg);
+	if (mcus == nullptr) {
+		std::cout << "MCU Array Deleted\n";
+		return "";
+	}
 
-		inverseDCT(jpeg, mcus);
+	dequantize(jpeg, mcus, &pool);
 
-		convertToRGB(jpeg, mcus);
+	inverseDCT(jpeg, mcus, &pool, 8);
 
-		const std::size_t pos = filename.find_last_of(".");
-		const std::string outName = (pos == std::string::npos) ? (filename + ".bmp") : (filename.substr(0, pos) + ".bmp");
+	convertToRGB(jpeg, mcus, &pool);
+
+	bool written = true;
+	if (options.outputJPEG) {
+		CoefficientImage* coefficients = forwardTransform(mcus, jpeg, options.quality, &pool);
+		written = coefficients != nullptr && encodeCoefficients(outName, coefficients, options.optimizeHuffman, options.restartInterval);
+		delete coefficients;
+	}
+	else {
 		writeBMP(outName, mcus, jpeg);
+	}
 
+	delete[] mcus;
+	return written ? outName : "";
+}
 
-		delete[] mcus;
+// Loads the row index sidecar of filename, building and saving it first when it is missing or out of date
+bool loadRowIndex(const std::string& filename, const std::string& indexPath, RowIndex& index) {
+	if (index.load(indexPath, filename)) {
+		return true;
+	}
+	std::cout << "Building row index " + indexPath + "\n";
+	if (!index.build(filename)) {
+		return false;
+	}
+	if (!index.save(indexPath)) {
+		std::cout << "Error: Could not write row index " + indexPath + "\n";
+	}
+	return true;
+}
+
+// Writes pixel rows [options.firstRow, options.lastRow] of filename as a bitmap in stored orientation,
+// decoding only the MCU rows that cover them. Returns the output file name, or an empty string on failure.
+std::string convertRowBand(const std::string& filename, const DecodeOptions& options) {
+	const std::size_t pos = filename.find_last_of(".");
+	const std::string baseName = (pos == std::string::npos) ? filename : filename.substr(0, pos);
+	RowIndex index;
+	if (!loadRowIndex(filename, baseName + ".idx", index)) {
+		return "";
+	}
+	const uint firstMCURow = options.firstRow / 8;
+	const uint lastMCURow = std::min(options.lastRow / 8, index.rows() - 1);
+	const std::string outName = baseName + ".rows" + std::to_string(options.firstRow) + "-" + std::to_string(options.lastRow) + ".bmp";
+
+	std::unique_ptr<BitmapRowWriter> writer;
+	std::vector<byte> pixels;
+	uint width = 0;
+	uint lastRow = 0;
+	uint channels = 3;
+	const auto onHeader = [&](const JPEGImage* const jpeg) {
+		// The last MCU row may extend past the image, rows in its padding are outside as well
+		if (options.firstRow >= jpeg->height) {
+			std::cout << "Error: Rows outside of the image\n";
+			return false;
+		}
+		width = jpeg->width;
+		lastRow = std::min(options.lastRow, jpeg->height - 1);
+		channels = (jpeg->numComponents == 1) ? 1 : 3;
+		pixels.resize((size_t)width * channels);
+		writer.reset(new BitmapRowWriter(outName, width, lastRow - options.firstRow + 1, channels * 8));
+		return writer->isOpen();
+	};
+	const auto onRow = [&](uint mcuRow, const MCU* const rowMCUs) {
+		for (uint y = std::max(mcuRow * 8, options.firstRow); y < mcuRow * 8 + 8 && y <= lastRow; ++y) {
+			for (uint x = 0; x < width; ++x) {
+				const MCU& mcu = rowMCUs[x / 8];
+				const uint pixelID = (y % 8) * 8 + x % 8;
+				byte* const pixel = &pixels[(size_t)x * channels];
+				pixel[0] = (byte)mcu.r[pixelID];
+				if (channels == 3) {
+					pixel[1] = (byte)mcu.g[pixelID];
+					pixel[2] = (byte)mcu.b[pixelID];
+				}
+			}
+			writer->writeRow(y - options.firstRow, pixels.data());
+		}
+	};
+	if (!index.decodeRows(filename, firstMCURow, lastMCURow - firstMCURow + 1, onHeader, onRow)) {
+		return "";
+	}
+	return outName;
+}
+
+// Feeds the input to an IncrementalDecoder in chunks as they are read, so bitmap rows are written while
+// later bytes are still arriving. A filename of "-" reads standard input.
+// Returns the output file name, or an empty string when the input could not be converted.
+std::string convertStreamed(const std::string& filename, const DecodeOptions& options) {
+	std::ifstream inFile;
+	std::istream* input = &std::cin;
+	if (filename != "-") {
+		inFile.open(filename, std::ios::in | std::ios::binary);
+		if (!inFile.is_open()) {
+			std::cout << "Error: Could not open file\n";
+			return "";
+		}
+		input = &inFile;
+	}
+	const std::size_t pos = filename.find_last_of(".");
+	const std::string baseName = (filename == "-") ? "stdin" : (pos == std::string::npos) ? filename : filename.substr(0, pos);
+	const std::string outName = baseName + ".bmp";
+
+	std::unique_ptr<BitmapRowWriter> writer;
+	std::vector<GrayMCU> grayRow;
+	IncrementalDecoder decoder(
+		[&](const JPEGImage* const jpeg) {
+			const uint orientation = options.applyOrientation ? jpeg->exif.orientation : 1;
+			writer.reset(new BitmapRowWriter(outName, jpeg->width, jpeg->height, (jpeg->numComponents == 1) ? 8 : 24, orientation));
+			grayRow.resize((jpeg->numComponents == 1) ? (jpeg->width + 7) / 8 : 0);
+			return writer->isOpen();
+		},
+		[&](uint row, const MCU* const rowMCUs) {
+			if (grayRow.empty()) {
+				writer->writeMCURow(row, rowMCUs);
+				return;
+			}
+			// Single component rows go to an 8-bit file like every other grayscale path
+			for (size_t k = 0; k < grayRow.size(); ++k) {
+				std::copy(rowMCUs[k].r, rowMCUs[k].r + 64, grayRow[k].y);
+			}
+			writer->writeMCURow(row, grayRow.data());
+		});
+
+	std::vector<char> chunk(streamChunkSize);
+	while (*input) {
+		input->read(chunk.data(), (std::streamsize)chunk.size());
+		const size_t received = (size_t)input->gcount();
+		if (received != 0 && !decoder.push((const byte*)chunk.data(), received)) {
+			return "";
+		}
+	}
+	if (!decoder.finish()) {
+		return "";
+	}
+	return outName;
+}
+
+// Decodes every frame of a Motion JPEG stream, read whole from a file or in chunks from stdin for "-", writing every
+// options.frameStep-th frame as <base>.<frame>.bmp. Returns false when no frame could be decoded.
+bool convertMotionJPEG(const std::string& filename, const DecodeOptions& options, ThreadPool& pool) {
+	const std::size_t pos = filename.find_last_of(".");
+	const std::string baseName = (filename == "-") ? "stdin" : (pos == std::string::npos) ? filename : filename.substr(0, pos);
+	uint64 pixels = 0;
+	uint width = 0;
+	uint height = 0;
+	std::vector<GrayMCU> grayBlocks;
+	FrameDecoder decoder(pool, [&](uint frame, const JPEGImage* const jpeg, const MCU* const mcus) {
+		pixels += (uint64)jpeg->width * jpeg->height;
+		width = jpeg->width;
+		height = jpeg->height;
+		if (options.frameStep == 0 || frame % options.frameStep != 0) {
+			return;
+		}
+		const std::string outName = baseName + "." + std::to_string(frame) + ".bmp";
+		if (jpeg->numComponents != 1) {
+			writeBMP(outName, mcus, jpeg);
+			return;
+		}
+		// Single component frames go to an 8-bit file like every other grayscale path
+		grayBlocks.resize((size_t)((jpeg->width + 7) / 8) * ((jpeg->height + 7) / 8));
+		for (size_t k = 0; k < grayBlocks.size(); ++k) {
+			std::copy(mcus[k].r, mcus[k].r + 64, grayBlocks[k].y);
+		}
+		writeGrayscaleBMP(outName, grayBlocks.data(), jpeg);
+	});
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if (filename == "-") {
+		std::vector<char> chunk(streamChunkSize);
+		while (std::cin) {
+			std::cin.read(chunk.data(), (std::streamsize)chunk.size());
+			const size_t received = (size_t)std::cin.gcount();
+			if (received != 0) {
+				decoder.push((const byte*)chunk.data(), received);
+			}
+		}
+		decoder.finish();
+	}
+	else {
+		std::vector<byte> data;
+		if (!readFile(filename, data)) {
+			std::cout << "Error: Could not open file\n";
+			return false;
+		}
+		decoder.decodeBuffer(data);
+	}
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	const uint frames = decoder.framesDecoded();
+	std::cout << "Decoded " << frames << " frames of " << filename << " (last " << width << "x" << height << "), " << decoder.framesFailed() <<
+		" failed, " << decoder.headersReused() << " with reused headers\n";
+	if (seconds > 0) {
+		std::cout << "Throughput: " << frames / seconds << " fps, " << pixels / seconds / 1e6 << " Mpixel/s over " << seconds << " s\n";
+	}
+	return frames != 0;
+}
+
+// Estimated peak memory of converting a width x height image with components components from a file of fileSize bytes.
+// Errs on the high side: EXIF orientation and thumbnails are not known before parsing, so the worst case is assumed.
+uint64 estimateDecodeMemory(uint width, uint height, uint components, uint64 fileSize, const DecodeOptions& options) {
+	const uint64 mcuCols = (width + 7) / 8;
+	const uint64 blocks = mcuCols * ((height + 7) / 8);
+	const uint64 pixels = (uint64)width * height;
+	// The file and its unstuffed scan data are held for the whole decode
+	uint64 bytes = 2 * fileSize;
+	if (options.analyze) {
+		return bytes + blocks * components * sizeof(int);
+	}
+	if (options.coefficientsOnly || (options.outputJPEG && options.quality == 0)) {
+		return bytes + blocks * components * 64 * sizeof(int) + fileSize;
+	}
+	if (options.pyramid) {
+		// Every level holds one band of tiles, the levels below the first add up to less than it
+		return bytes + (uint64)options.ringRows * mcuCols * sizeof(MCU) + 2 * (uint64)options.tileSize * width * 3;
+	}
+	const bool ring = options.pipelined && components != 1 && !options.outputJPEG && options.pixelFormat != PixelFormat::YCbCrPlanar;
+	if (ring) {
+		bytes += (uint64)options.ringRows * mcuCols * sizeof(MCU);
+	}
+	else {
+		bytes += blocks * ((components == 1) ? sizeof(GrayMCU) : sizeof(MCU));
+	}
+	if (options.outputJPEG) {
+		bytes += blocks * 3 * 64 * sizeof(int) + fileSize;
+	}
+	else if (options.pixelFormat != PixelFormat::Bitmap) {
+		const uint64 rowBytes = (uint64)width * ((options.pixelFormat == PixelFormat::BGRA32) ? 4 : 1) + options.rowAlignment;
+		bytes += std::max<uint64>(options.stride, rowBytes) * height * ((options.pixelFormat == PixelFormat::BGRA32) ? 1 : 3);
+	}
+	else if (options.outputPGM) {
+		bytes += 2 * pixels;
+	}
+	else {
+		// Rotated orientations keep the whole bitmap until it is written
+		bytes += pixels * ((components == 1) ? 1 : 3);
+	}
+	return bytes;
+}
+
+// Parses an input already read into memory and converts it as options select.
+// Returns the output file name, or an empty string when the input could not be converted.
+std::string convertInput(const std::string& filename, const std::vector<byte>& data, const DecodeOptions& options, ThreadPool& pool) {
+	JPEGImage* jpeg = parseJPEG(data);
+
+	// validate jpeg
+	if (jpeg == nullptr) {
+		return "";
+	}
+	else if (jpeg->isValid == false)
+	{
+		std::cout << "Error: Provided file " + filename + " is an invalid JPEG\n";
 		delete jpeg;
+		return "";
+	}
+
+	if (!options.applyOrientation) {
+		jpeg->exif.orientation = 1;
+	}
+
+	// A small enough requested size is served from the embedded thumbnail without touching the main scan
+	if (options.thumbnailSize != 0) {
+		JPEGImage* thumbnail = parseThumbnail(jpeg, options.thumbnailSize);
+		if (thumbnail != nullptr) {
+			std::cout << "Using " + std::to_string(thumbnail->width) + "x" + std::to_string(thumbnail->height) + " EXIF thumbnail of " + filename + "\n";
+			thumbnail->exif.orientation = jpeg->exif.orientation;
+			delete jpeg;
+			jpeg = thumbnail;
+		}
+	}
+
+	printjpeg(jpeg);
+	const std::size_t pos = filename.find_last_of(".");
+	const std::string baseName = (pos == std::string::npos) ? filename : filename.substr(0, pos);
+	const std::string outName = convertJPEG(jpeg, baseName, options, pool);
+	delete jpeg;
+	return outName;
+}
+
+// DC-only statistics of an input already read into memory, as one line.
+// Returns an empty string when the input could not be analyzed.
+std::string analyzeInput(const std::string& filename, const std::vector<byte>& data) {
+	std::unique_ptr<JPEGImage> jpeg(parseJPEG(data));
+	if (jpeg == nullptr) {
+		return "";
+	}
+	if (!jpeg->isValid) {
+		std::cout << "Error: Provided file " + filename + " is an invalid JPEG\n";
+		return "";
+	}
+	ImageAnalytics analytics;
+	if (!analyzeDC(jpeg.get(), analytics)) {
+		return "";
+	}
+	return formatAnalytics(analytics);
+}
+
+// Splits a server request into arguments at whitespace, double quotes keep paths with spaces together
+std::vector<std::string> splitRequest(const std::string& request) {
+	std::vector<std::string> arguments;
+	std::string current;
+	bool quoted = false;
+	bool started = false;
+	for (const char c : request) {
+		if (c == '"') {
+			quoted = !quoted;
+			started = true;
+		}
+		else if (!quoted && (c == ' ' || c == '\t')) {
+			if (started) {
+				arguments.push_back(current);
+			}
+			current.clear();
+			started = false;
+		}
+		else {
+			current += c;
+			started = true;
+		}
+	}
+	if (started) {
+		arguments.push_back(current);
+	}
+	return arguments;
+}
+
+// Handles one server request, a command line of options and input files applied on top of the server's own options.
+// Answers "ok" followed by the output paths, or the analytics lines separated by "; " for --analyze,
+// or "error" and the reason at the first input that fails.
+std::string handleRequest(const std::string& request, const DecodeOptions& serverOptions, ThreadPool& pool) {
+	std::vector<std::string> arguments = splitRequest(request);
+	std::vector<char*> argv(1, nullptr);
+	for (std::string& argument : arguments) {
+		argv.push_back(&argument[0]);
+	}
+	DecodeOptions options = serverOptions;
+	options.serve = false;
+	std::vector<std::string> files;
+	if (!parseOptions((int)argv.size(), argv.data(), options, files)) {
+		return "error Invalid options";
+	}
+	// The pool and the input reading are fixed when the server starts
+	if (options.incremental || options.conformance || options.serve || options.mjpeg || options.rowBand || options.buildIndex || options.streamed ||
+		options.memoryBudgetMB != serverOptions.memoryBudgetMB || options.threadCount != serverOptions.threadCount || options.serialThreshold != serverOptions.serialThreshold) {
+		return "error Option not available per request";
+	}
+	if (files.empty()) {
+		return "error No file specified for conversion";
+	}
+	std::string response = "ok";
+	std::vector<byte> data;
+	for (const std::string& filename : files) {
+		if (!readFile(filename, data)) {
+			return "error Could not open " + filename;
+		}
+		if (options.analyze) {
+			const std::string line = analyzeInput(filename, data);
+			if (line.empty()) {
+				return "error Could not analyze " + filename;
+			}
+			response += (response == "ok" ? " " : "; ") + line;
+			continue;
+		}
+		const std::string outName = convertInput(filename, data, options, pool);
+		if (outName.empty()) {
+			return "error Could not convert " + filename;
+		}
+		response += " " + outName;
+	}
+	return response;
+}
+
+int main(int argc, char** argv) {
+	DecodeOptions options;
+	std::vector<std::string> files;
+	if (!parseOptions(argc, argv, options, files)) {
+		return 0;
+	}
+	if (options.conformance) {
+		ThreadPool pool(options.threadCount, options.serialThreshold);
+		return runConformance(files, pool) ? 0 : 1;
+	}
+	// One process, pool and set of decode tables serves every request instead of starting per conversion
+	if (options.serve) {
+		if (!files.empty()) {
+			std::cout << "Error: The server takes its input files from requests\n";
+			return 0;
+		}
+		ThreadPool pool(options.threadCount, options.serialThreshold);
+		const auto handle = [&options, &pool](const std::string& request) { return handleRequest(request, options, pool); };
+		if (options.socketPath.empty()) {
+			serveStdin(handle);
+			return 0;
+		}
+		return serveSocket(options.socketPath, handle) ? 0 : 1;
+	}
+	if (files.empty()) {
+		std::cout << "Error: No file specified for conversion\n";
+		return 0;
+	}
+
+	if (options.buildIndex) {
+		for (const std::string& filename : files) {
+			const std::size_t pos = filename.find_last_of(".");
+			const std::string indexPath = ((pos == std::string::npos) ? filename : filename.substr(0, pos)) + ".idx";
+			RowIndex index;
+			if (!index.build(filename) || !index.save(indexPath)) {
+				std::cout << "Error: Could not index " + filename + "\n";
+			}
+		}
+		return 0;
+	}
+	if (options.rowBand) {
+		for (const std::string& filename : files) {
+			if (convertRowBand(filename, options).empty()) {
+				std::cout << "Error: Row band decode of " + filename + " failed\n";
+			}
+		}
+		return 0;
+	}
+	if (options.streamed) {
+		for (const std::string& filename : files) {
+			if (convertStreamed(filename, options).empty()) {
+				std::cout << "Error: Streamed decode of " + filename + " failed\n";
+			}
+		}
+		return 0;
+	}
+	if (options.mjpeg) {
+		ThreadPool pool(options.threadCount, options.serialThreshold);
+		for (const std::string& filename : files) {
+			if (!convertMotionJPEG(filename, options, pool)) {
+				std::cout << "Error: Motion JPEG decode of " + filename + " failed\n";
+			}
+		}
+		return 0;
+	}
+
+	ThreadPool pool(options.threadCount, options.serialThreshold);
+	BatchManifest manifest(options.manifestPath);
+	if (options.incremental) {
+		manifest.load();
+	}
+	// Inputs that still need converting, an mtime keyed manifest is checked before any read is issued
+	std::vector<std::string> pending;
+	std::vector<ManifestEntry> entries;
+	for (const std::string& filename : files) {
+		ManifestEntry current;
+		if (options.incremental) {
+			if (!statFile(filename, current.size, current.modifiedTime)) {
+				std::cout << "Error: Could not open file\n";
+				continue;
+			}
+			current.optionsKey = outputOptionsKey(options);
+			if (!options.cacheByContent && manifest.isUpToDate(filename, current, false)) {
+				std::cout << "Skipping unchanged " + filename + "\n";
+				continue;
+			}
+		}
+		pending.push_back(filename);
+		entries.push_back(current);
+	}
+
+	// Handles an input once it was read. The scheduler runs it on several threads, so the manifest is shared under a lock.
+	std::mutex manifestMutex;
+	const auto processInput = [&options, &pool, &manifest, &manifestMutex](const std::string& filename, const std::vector<byte>& data,
+		ManifestEntry& current) {
+		if (options.incremental && options.cacheByContent) {
+			std::lock_guard<std::mutex> lock(manifestMutex);
+			if (manifest.isUpToDate(filename, current, true)) {
+				std::cout << "Skipping unchanged " + filename + "\n";
+				return;
+			}
+		}
+		if (options.analyze) {
+			const std::string line = analyzeInput(filename, data);
+			if (!line.empty()) {
+				std::cout << "Analytics " + filename + ": " + line + "\n";
+			}
+			return;
+		}
+		const std::string outName = convertInput(filename, data, options, pool);
+
+		uint64 outputModifiedTime = 0;
+		if (options.incremental && !outName.empty() && statFile(outName, current.outputSize, outputModifiedTime)) {
+			current.output = outName;
+			std::lock_guard<std::mutex> lock(manifestMutex);
+			manifest.record(filename, current);
+		}
+	};
+
+	if (options.memoryBudgetMB != 0) {
+		// Probe every frame header first so each input can be admitted against the budget by its estimated decode memory.
+		// Inputs are read inside their job, the read ahead would hold memory the budget does not know about.
+		const uint64 budget = (uint64)options.memoryBudgetMB << 20;
+		std::vector<uint64> costs(pending.size(), budget);
+		for (size_t i = 0; i < pending.size(); ++i) {
+			uint width = 0;
+			uint height = 0;
+			uint components = 0;
+			uint64 size = 0;
+			uint64 modifiedTime = 0;
+			if (probeFrame(pending[i], width, height, components) && statFile(pending[i], size, modifiedTime)) {
+				costs[i] = estimateDecodeMemory(width, height, components, size, options);
+			}
+		}
+		BatchScheduler scheduler(budget, pool.size(), pool.size() * scheduleBypassPerSlot);
+		scheduler.run(costs, [&pending, &entries, &options, &processInput](size_t i) {
+			std::vector<byte> data;
+			ManifestEntry& current = entries[i];
+			const bool read = (options.incremental && options.cacheByContent) ? readFileHashed(pending[i], data, current.hash) :
+				readFile(pending[i], data);
+			if (!read) {
+				std::cout << "Error: Could not open file\n";
+				return;
+			}
+			processInput(pending[i], data, current);
+		});
+		std::cout << "Scheduled " + std::to_string(pending.size()) + " inputs, at most " + std::to_string(scheduler.maxConcurrency()) +
+			" at once and " + std::to_string(scheduler.peakAdmitted() >> 20) + " MB of " + std::to_string(options.memoryBudgetMB) +
+			" MB estimated\n";
+	}
+	else {
+		// read jpegs ahead of the decoder, hashing them when the manifest is keyed on content
+		ReadAhead reader(pending, options.readAheadDepth, (uint64)options.readAheadMemoryMB << 20, options.incremental && options.cacheByContent);
+		std::string filename;
+		std::vector<byte> data;
+		uint64 hash = 0;
+		bool read = false;
+		for (size_t i = 0; reader.next(filename, data, hash, read); ++i) {
+			ManifestEntry& current = entries[i];
+			current.hash = hash;
+			if (!read) {
+				std::cout << "Error: Could not open file\n";
+				continue;
+			}
+			processInput(filename, data, current);
+		}
+	}
+	if (options.incremental && !manifest.save()) {
+		std::cout << "Error: Could not write manifest " + options.manifestPath + "\n";
 	}
 }
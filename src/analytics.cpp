@@ -0,0 +1,155 @@
+#include "../include/analytics.h"
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+
+bool decodeDCCoefficients(JPEGImage* const, std::vector<int>* const);
+
+// Side of the luma thumbnail the perceptual hash is taken from, and of the low frequency corner it keeps
+const uint hashImageSize = 32;
+const uint hashFrequencies = 8;
+
+byte clampSample(double value) {
+	return (byte)std::min(255.0, std::max(0.0, std::floor(value + 0.5)));
+}
+
+// Area average of a width x height plane down (or up) to size x size
+std::vector<double> resampleSquare(const std::vector<double>& plane, uint width, uint height, uint size) {
+	std::vector<double> out((size_t)size * size, 0.0);
+	const double scaleX = (double)width / size;
+	const double scaleY = (double)height / size;
+	for (uint oy = 0; oy < size; ++oy) {
+		const double top = oy * scaleY;
+		const double bottom = top + scaleY;
+		for (uint ox = 0; ox < size; ++ox) {
+			const double left = ox * scaleX;
+			const double right = left + scaleX;
+			double sum = 0.0;
+			for (uint y = (uint)top; y < height && y < bottom; ++y) {
+				const double coverY = std::min(bottom, y + 1.0) - std::max(top, (double)y);
+				for (uint x = (uint)left; x < width && x < right; ++x) {
+					const double coverX = std::min(right, x + 1.0) - std::max(left, (double)x);
+					sum += plane[(size_t)y * width + x] * coverX * coverY;
+				}
+			}
+			out[(size_t)oy * size + ox] = sum / (scaleX * scaleY);
+		}
+	}
+	return out;
+}
+
+// 64 bit DCT hash: the lowest 8x8 frequencies of a 32x32 luma thumbnail, each bit set when the coefficient is above
+// their median. The DC term only takes part as a bit, it would otherwise shift the median with the overall brightness.
+uint64 perceptualHash(const std::vector<double>& luma, uint width, uint height) {
+	const std::vector<double> small = resampleSquare(luma, width, height, hashImageSize);
+	double basis[hashFrequencies][hashImageSize];
+	for (uint u = 0; u < hashFrequencies; ++u) {
+		for (uint x = 0; x < hashImageSize; ++x) {
+			basis[u][x] = std::cos((2.0 * x + 1.0) * u * U_PI / (2.0 * hashImageSize));
+		}
+	}
+	// Rows first, then the columns of the kept frequencies
+	std::vector<double> rows((size_t)hashImageSize * hashFrequencies, 0.0);
+	for (uint y = 0; y < hashImageSize; ++y) {
+		for (uint u = 0; u < hashFrequencies; ++u) {
+			double sum = 0.0;
+			for (uint x = 0; x < hashImageSize; ++x) {
+				sum += small[(size_t)y * hashImageSize + x] * basis[u][x];
+			}
+			rows[(size_t)y * hashFrequencies + u] = sum;
+		}
+	}
+	double frequencies[hashFrequencies * hashFrequencies];
+	for (uint v = 0; v < hashFrequencies; ++v) {
+		for (uint u = 0; u < hashFrequencies; ++u) {
+			double sum = 0.0;
+			for (uint y = 0; y < hashImageSize; ++y) {
+				sum += rows[(size_t)y * hashFrequencies + u] * basis[v][y];
+			}
+			frequencies[v * hashFrequencies + u] = sum;
+		}
+	}
+	std::vector<double> sorted(frequencies + 1, frequencies + hashFrequencies * hashFrequencies);
+	std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+	const double median = sorted[sorted.size() / 2];
+	uint64 hash = 0;
+	for (uint i = 0; i < hashFrequencies * hashFrequencies; ++i) {
+		if (frequencies[i] > median) {
+			hash |= (uint64)1 << i;
+		}
+	}
+	return hash;
+}
+
+bool analyzeDC(JPEGImage* const jpeg, ImageAnalytics& analytics) {
+	std::vector<int> planes[3];
+	if (!decodeDCCoefficients(jpeg, planes)) {
+		return false;
+	}
+	analytics = ImageAnalytics();
+	analytics.width = jpeg->width;
+	analytics.height = jpeg->height;
+	analytics.blocksWide = (jpeg->width + 7) / 8;
+	analytics.blocksHigh = (jpeg->height + 7) / 8;
+	analytics.channels = (jpeg->numComponents == 1) ? 1 : 3;
+	const size_t blocks = (size_t)analytics.blocksWide * analytics.blocksHigh;
+	analytics.pixels.resize(blocks * analytics.channels);
+
+	// A dequantized DC coefficient is eight times the mean of its block's level shifted samples
+	std::vector<double> luma(blocks);
+	double sums[3] = { 0.0 };
+	for (uint by = 0; by < analytics.blocksHigh; ++by) {
+		// Edge blocks are weighted by the pixels of the image they cover, not their padding
+		const uint coveredRows = std::min(8u, jpeg->height - by * 8);
+		for (uint bx = 0; bx < analytics.blocksWide; ++bx) {
+			const size_t i = (size_t)by * analytics.blocksWide + bx;
+			const uint covered = coveredRows * std::min(8u, jpeg->width - bx * 8);
+			const double y = planes[0][i] / 8.0;
+			luma[i] = y + 128.0;
+			byte rgb[3];
+			if (analytics.channels == 1) {
+				rgb[0] = rgb[1] = rgb[2] = clampSample(y + 128.0);
+				analytics.pixels[i] = rgb[0];
+			}
+			else {
+				const double cb = planes[1][i] / 8.0;
+				const double cr = planes[2][i] / 8.0;
+				rgb[0] = clampSample(y + 1.402 * cr + 128.0);
+				rgb[1] = clampSample(y - 0.344136 * cb - 0.714136 * cr + 128.0);
+				rgb[2] = clampSample(y + 1.772 * cb + 128.0);
+				std::copy(rgb, rgb + 3, &analytics.pixels[i * 3]);
+			}
+			uint bin = 0;
+			for (uint c = 0; c < 3; ++c) {
+				sums[c] += (double)rgb[c] * covered;
+				bin = bin * histogramLevels + rgb[c] * histogramLevels / 256;
+			}
+			analytics.histogram[bin] += covered;
+		}
+	}
+	const double pixelCount = (double)jpeg->width * jpeg->height;
+	for (uint c = 0; c < 3; ++c) {
+		analytics.meanColor[c] = sums[c] / pixelCount;
+	}
+	analytics.perceptualHash = perceptualHash(luma, analytics.blocksWide, analytics.blocksHigh);
+	return true;
+}
+
+std::string formatAnalytics(const ImageAnalytics& analytics) {
+	std::ostringstream line;
+	line << analytics.width << "x" << analytics.height << std::fixed << std::setprecision(1)
+		<< " mean=" << analytics.meanColor[0] << "," << analytics.meanColor[1] << "," << analytics.meanColor[2]
+		<< " phash=" << std::hex << std::setw(16) << std::setfill('0') << analytics.perceptualHash << std::dec
+		<< " histogram=";
+	const double pixelCount = (double)analytics.width * analytics.height;
+	for (uint i = 0; i < histogramLevels * histogramLevels * histogramLevels; ++i) {
+		// Per mille of the image, empty bins are left blank to keep the line short
+		line << (i == 0 ? "" : ",");
+		if (analytics.histogram[i] != 0) {
+			line << std::setprecision(0) << analytics.histogram[i] * 1000.0 / pixelCount;
+		}
+	}
+	return line.str();
+}
@@ -1,50 +1,304 @@
 #include "../include/jpeg.h"
+#include "../include/bitmap_encoder.h"
 #include <iostream>
 #include <fstream>
+#include <cstdio>
 
-void writeBMP(const std::string& savefile_name, const MCU* const mcus, const JPEGImage* jpeg_data) {
-	std::ofstream outFile = std::ofstream(savefile_name, std::ios::out | std::ios::binary);
+const uint bmpHeaderSize = 14 + 12;
+
+void orientPixel(uint orientation, uint width, uint height, uint x, uint y, uint& dx, uint& dy) {
+	switch (orientation) {
+	case 2: // mirrored horizontally
+		dx = width - 1 - x;
+		dy = y;
+		break;
+	case 3: // rotated 180
+		dx = width - 1 - x;
+		dy = height - 1 - y;
+		break;
+	case 4: // mirrored vertically
+		dx = x;
+		dy = height - 1 - y;
+		break;
+	case 5: // transposed
+		dx = y;
+		dy = x;
+		break;
+	case 6: // rotated 90 clockwise
+		dx = height - 1 - y;
+		dy = x;
+		break;
+	case 7: // transversed
+		dx = height - 1 - y;
+		dy = width - 1 - x;
+		break;
+	case 8: // rotated 90 counter clockwise
+		dx = y;
+		dy = width - 1 - x;
+		break;
+	default:
+		dx = x;
+		dy = y;
+		break;
+	}
+}
+
+BitmapRowWriter::BitmapRowWriter(const std::string& filename, uint width, uint height, uint bitsPerPixel, uint orientation) :
+	filename(filename), outFile(filename, std::ios::out | std::ios::binary), width(width), height(height), bytesPerPixel(bitsPerPixel / 8),
+	orientation(orientation), transposed(orientation >= 5 && orientation <= 8),
+	outWidth(transposed ? height : width), outHeight(transposed ? width : height),
+	rowSize((outWidth * bytesPerPixel + 3) & ~3u), pixelOffset(bmpHeaderSize + ((bitsPerPixel == 8) ? 256 * 3 : 0)),
+	pixelStep(0) {
 	if (!outFile.is_open()) {
 		std::cout << "Error: Could not open output file\n";
 		return;
 	}
-
-	const uint mcuRows = (jpeg_data->height + 7) / 8;
-	const uint mcuCols = (jpeg_data->width + 7) / 8;
-	const uint padding = jpeg_data->width % 4;
-	const uint bmp_filesize = 14 + 12 + jpeg_data->height * jpeg_data->width * 3 + padding * jpeg_data->height;
-
+	if (transposed) {
+		image.assign((size_t)outHeight * rowSize, 0);
+	}
+	else {
+		band.assign(8 * rowSize, 0);
+	}
+	pixelStep = (width > 1) ? fileOffset(1, 0) - fileOffset(0, 0) : 0;
+	const uint bmp_filesize = pixelOffset + outHeight * rowSize;
 
 	// Bitmap Header Structure:
 	outFile.put('B');
 	outFile.put('M');
 	putLong(outFile, bmp_filesize);
 	putLong(outFile, 0);
-	putLong(outFile, 0x1A);
+	putLong(outFile, pixelOffset);
 	// DIB Header:
 	putLong(outFile, 12);
-	putShort(outFile, jpeg_data->width);
-	putShort(outFile, jpeg_data->height);
+	putShort(outFile, outWidth);
+	putShort(outFile, outHeight);
 	putShort(outFile, 1);
-	putShort(outFile, 24);
+	putShort(outFile, bitsPerPixel);
+	if (bitsPerPixel == 8) {
+		// Identity grayscale palette, one BGR triple per entry
+		for (uint i = 0; i < 256; ++i) {
+			outFile.put(i);
+			outFile.put(i);
+			outFile.put(i);
+		}
+	}
+}
+
+BitmapRowWriter::~BitmapRowWriter() {
+	if (outFile.is_open() && transposed) {
+		outFile.seekp(pixelOffset);
+		outFile.write(image.data(), (std::streamsize)image.size());
+	}
+}
+
+bool BitmapRowWriter::isOpen() const {
+	return outFile.is_open();
+}
+
+void BitmapRowWriter::discard() {
+	if (outFile.is_open()) {
+		outFile.close();
+		std::remove(filename.c_str());
+	}
+}
+
+// Byte offset of source pixel (x, y) in the bottom-up pixel array of the file
+std::ptrdiff_t BitmapRowWriter::fileOffset(uint x, uint y) const {
+	uint dx = 0;
+	uint dy = 0;
+	orientPixel(orientation, width, height, x, y, dx, dy);
+	return (std::ptrdiff_t)(outHeight - 1 - dy) * rowSize + (std::ptrdiff_t)dx * bytesPerPixel;
+}
+
+// First file row covered by an MCU row of the non transposed orientations.
+// BMP rows are stored bottom-up, so upright MCU rows land in a reversed span and vertically flipped ones in a forward span.
+uint BitmapRowWriter::bandFileRow(uint firstRow, uint rows) const {
+	return (orientation == 3 || orientation == 4) ? firstRow : height - firstRow - rows;
+}
 
-	#pragma warning(push)
-	#pragma warning(disable: 6293)
-	for (uint i = jpeg_data->height - 1; i < jpeg_data->height; --i) {
-		const uint mcuRow = i / 8;
-		const uint pixelRow = i % 8;
+// Buffer the MCU row is placed into, origin is the file offset of its first byte
+char* BitmapRowWriter::bandTarget(uint firstRow, uint rows, std::ptrdiff_t& origin) {
+	if (transposed) {
+		origin = 0;
+		return image.data();
+	}
+	origin = (std::ptrdiff_t)bandFileRow(firstRow, rows) * rowSize;
+	return band.data();
+}
+
+void BitmapRowWriter::writeMCURow(uint mcuRow, const MCU* const rowMCUs) {
+	if (!outFile.is_open()) {
+		return;
+	}
+	const uint firstRow = mcuRow * 8;
+	const uint rows = (height - firstRow < 8) ? (height - firstRow) : 8;
+	std::ptrdiff_t origin = 0;
+	char* const target = bandTarget(firstRow, rows, origin);
+	// One 8x8 block at a time, so the transposed orientations touch 8 output rows at a time
+	for (uint c = 0; c * 8 < width; ++c) {
+		const MCU& mcu = rowMCUs[c];
+		const uint columns = (width - c * 8 < 8) ? (width - c * 8) : 8;
+		for (uint pixelRow = 0; pixelRow < rows; ++pixelRow) {
+			char* out = target + (fileOffset(c * 8, firstRow + pixelRow) - origin);
+			for (uint k = 0; k < columns; ++k, out += pixelStep) {
+				const uint pixelID = pixelRow * 8 + k;
+				out[0] = mcu.b[pixelID];
+				out[1] = mcu.g[pixelID];
+				out[2] = mcu.r[pixelID];
+			}
+		}
+	}
+	writeBand(firstRow, rows);
+}
+
+void BitmapRowWriter::writeMCURow(uint mcuRow, const GrayMCU* const rowMCUs) {
+	if (!outFile.is_open()) {
+		return;
+	}
+	const uint firstRow = mcuRow * 8;
+	const uint rows = (height - firstRow < 8) ? (height - firstRow) : 8;
+	std::ptrdiff_t origin = 0;
+	char* const target = bandTarget(firstRow, rows, origin);
+	for (uint c = 0; c * 8 < width; ++c) {
+		const GrayMCU& block = rowMCUs[c];
+		const uint columns = (width - c * 8 < 8) ? (width - c * 8) : 8;
+		for (uint pixelRow = 0; pixelRow < rows; ++pixelRow) {
+			char* out = target + (fileOffset(c * 8, firstRow + pixelRow) - origin);
+			for (uint k = 0; k < columns; ++k, out += pixelStep) {
+				*out = block.y[pixelRow * 8 + k];
+			}
+		}
+	}
+	writeBand(firstRow, rows);
+}
+
+void BitmapRowWriter::writeRow(uint row, const byte* const pixels) {
+	if (!outFile.is_open()) {
+		return;
+	}
+	std::ptrdiff_t origin = 0;
+	char* out = bandTarget(row, 1, origin) + (fileOffset(0, row) - origin);
+	if (bytesPerPixel == 1) {
+		for (uint k = 0; k < width; ++k, out += pixelStep) {
+			*out = pixels[k];
+		}
+	}
+	else {
+		for (uint k = 0; k < width; ++k, out += pixelStep) {
+			out[0] = pixels[k * 3 + 2];
+			out[1] = pixels[k * 3 + 1];
+			out[2] = pixels[k * 3];
+		}
+	}
+	writeBand(row, 1);
+}
+
+void BitmapRowWriter::writeBand(uint firstRow, uint rows) {
+	if (transposed) {
+		return;
+	}
+	outFile.seekp(pixelOffset + (std::streamoff)bandFileRow(firstRow, rows) * rowSize);
+	outFile.write(band.data(), (std::streamsize)rows * rowSize);
+}
+
+void writeBMP(const std::string& savefile_name, const MCU* const mcus, const JPEGImage* jpeg_data) {
+	BitmapRowWriter writer(savefile_name, jpeg_data->width, jpeg_data->height, 24, jpeg_data->exif.orientation);
+	if (!writer.isOpen()) {
+		return;
+	}
+
+	const uint mcuRows = (jpeg_data->height + 7) / 8;
+	const uint mcuCols = (jpeg_data->width + 7) / 8;
+	for (uint i = 0; i < mcuRows; ++i) {
+		writer.writeMCURow(i, mcus + i * mcuCols);
+	}
+}
+
+
+void writeGrayscaleBMP(const std::string& savefile_name, const GrayMCU* const blocks, const JPEGImage* jpeg_data) {
+	BitmapRowWriter writer(savefile_name, jpeg_data->width, jpeg_data->height, 8, jpeg_data->exif.orientation);
+	if (!writer.isOpen()) {
+		return;
+	}
+
+	const uint mcuRows = (jpeg_data->height + 7) / 8;
+	const uint mcuCols = (jpeg_data->width + 7) / 8;
+	for (uint i = 0; i < mcuRows; ++i) {
+		writer.writeMCURow(i, blocks + i * mcuCols);
+	}
+}
+
+ResizingRowWriter::ResizingRowWriter(uint width, uint height, uint blockSize, uint targetWidth, uint targetHeight, uint channels,
+	ResampleFilter filter, const Resampler::RowCallback& emit) :
+	width(width), height(height), blockSize(blockSize), channels(channels),
+	resampler(width, height, targetWidth, targetHeight, channels, filter), emit(emit), row((size_t)width * channels) {}
+
+void ResizingRowWriter::writeMCURow(uint mcuRow, const MCU* const rowMCUs) {
+	const uint firstRow = mcuRow * blockSize;
+	for (uint y = firstRow; y < firstRow + blockSize && y < height; ++y) {
+		const uint rowOffset = (y - firstRow) * 8;
+		for (uint x = 0; x < width; ++x) {
+			const MCU& mcu = rowMCUs[x / blockSize];
+			const uint pixelID = rowOffset + x % blockSize;
+			row[x * 3] = mcu.r[pixelID];
+			row[x * 3 + 1] = mcu.g[pixelID];
+			row[x * 3 + 2] = mcu.b[pixelID];
+		}
+		resampler.pushRow(row.data(), emit);
+	}
+}
+
+void ResizingRowWriter::writeMCURow(uint mcuRow, const GrayMCU* const rowMCUs) {
+	const uint firstRow = mcuRow * blockSize;
+	for (uint y = firstRow; y < firstRow + blockSize && y < height; ++y) {
+		const uint rowOffset = (y - firstRow) * 8;
+		for (uint x = 0; x < width; ++x) {
+			row[x] = rowMCUs[x / blockSize].y[rowOffset + x % blockSize];
+		}
+		resampler.pushRow(row.data(), emit);
+	}
+}
+
+// Binary PGM (P5), one byte per pixel, rows top-down
+void writePGM(const std::string& savefile_name, const GrayMCU* const blocks, const JPEGImage* jpeg_data) {
+	const uint mcuCols = (jpeg_data->width + 7) / 8;
+	std::vector<byte> pixels((size_t)jpeg_data->width * jpeg_data->height);
+	for (uint i = 0; i < jpeg_data->height; ++i) {
+		const GrayMCU* const rowBlocks = blocks + (i / 8) * mcuCols;
+		byte* const row = &pixels[(size_t)i * jpeg_data->width];
 		for (uint k = 0; k < jpeg_data->width; ++k) {
-			const uint mcuCol = k / 8;
-			const uint pixelCol = k % 8;
-			const uint mcuID = mcuCol + mcuRow * mcuCols;
-			const uint pixelID = pixelRow * 8 + pixelCol;
-			outFile.put(mcus[mcuID].b[pixelID]);
-			outFile.put(mcus[mcuID].g[pixelID]);
-			outFile.put(mcus[mcuID].r[pixelID]);
+			row[k] = rowBlocks[k / 8].y[(i % 8) * 8 + k % 8];
 		}
-		for (uint p = 0; p < padding; ++p) {
-			outFile.put(0);
+	}
+	writePGMPixels(savefile_name, pixels.data(), jpeg_data->width, jpeg_data->height, jpeg_data->exif.orientation);
+}
+
+// Writes a top-down gray frame as PGM, reoriented on the way out
+void writePGMPixels(const std::string& savefile_name, const byte* const pixels, uint width, uint height, uint orientation) {
+	std::ofstream outFile = std::ofstream(savefile_name, std::ios::out | std::ios::binary);
+	if (!outFile.is_open()) {
+		std::cout << "Error: Could not open output file\n";
+		return;
+	}
+	const bool transposed = orientation >= 5 && orientation <= 8;
+	const uint outWidth = transposed ? height : width;
+	const uint outHeight = transposed ? width : height;
+	outFile << "P5\n" << outWidth << " " << outHeight << "\n255\n";
+	if (orientation == 1) {
+		outFile.write((const char*)pixels, (std::streamsize)width * height);
+		outFile.close();
+		return;
+	}
+
+	std::vector<char> oriented((size_t)outWidth * outHeight);
+	for (uint y = 0; y < height; ++y) {
+		for (uint x = 0; x < width; ++x) {
+			uint dx = 0;
+			uint dy = 0;
+			orientPixel(orientation, width, height, x, y, dx, dy);
+			oriented[(size_t)dy * outWidth + dx] = pixels[(size_t)y * width + x];
 		}
 	}
+	outFile.write(oriented.data(), (std::streamsize)oriented.size());
 	outFile.close();
-}
\ No newline at end of file
+}
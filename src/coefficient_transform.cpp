@@ -0,0 +1,123 @@
+#include "../include/coefficient_transform.h"
+#include <iostream>
+#include <algorithm>
+
+LosslessTransform transformForOrientation(uint orientation) {
+	switch (orientation) {
+	case 2:
+		return LosslessTransform::FlipHorizontal;
+	case 3:
+		return LosslessTransform::Rotate180;
+	case 4:
+		return LosslessTransform::FlipVertical;
+	case 5:
+		return LosslessTransform::Transpose;
+	case 6:
+		return LosslessTransform::Rotate90;
+	case 7:
+		return LosslessTransform::Transverse;
+	case 8:
+		return LosslessTransform::Rotate270;
+	default:
+		return LosslessTransform::None;
+	}
+}
+
+// Every transform is an optional transpose followed by optional mirrors of the transposed image
+struct TransformSteps {
+	bool transpose = false;
+	bool flipHorizontal = false;
+	bool flipVertical = false;
+};
+
+TransformSteps transformSteps(LosslessTransform transform) {
+	TransformSteps steps;
+	steps.transpose = transform == LosslessTransform::Transpose || transform == LosslessTransform::Transverse ||
+		transform == LosslessTransform::Rotate90 || transform == LosslessTransform::Rotate270;
+	steps.flipHorizontal = transform == LosslessTransform::FlipHorizontal || transform == LosslessTransform::Rotate180 ||
+		transform == LosslessTransform::Rotate90 || transform == LosslessTransform::Transverse;
+	steps.flipVertical = transform == LosslessTransform::FlipVertical || transform == LosslessTransform::Rotate180 ||
+		transform == LosslessTransform::Rotate270 || transform == LosslessTransform::Transverse;
+	return steps;
+}
+
+// Mirroring a row of samples negates its odd horizontal frequencies, and likewise for columns and vertical frequencies.
+// Transposing the samples transposes the coefficients.
+void transformBlock(const int* const in, int* const out, const TransformSteps& steps) {
+	for (uint v = 0; v < 8; ++v) {
+		for (uint u = 0; u < 8; ++u) {
+			int coefficient = steps.transpose ? in[u * 8 + v] : in[v * 8 + u];
+			if ((steps.flipHorizontal && (u & 1) != 0) != (steps.flipVertical && (v & 1) != 0)) {
+				coefficient = -coefficient;
+			}
+			out[v * 8 + u] = coefficient;
+		}
+	}
+}
+
+// A mirrored side keeps only whole blocks, unless there are none
+uint trimmedLength(uint length, bool mirrored) {
+	return (mirrored && length >= 8) ? length / 8 * 8 : length;
+}
+
+CoefficientImage* transformCoefficients(const CoefficientImage* const image, LosslessTransform transform, const CropRegion& crop) {
+	const TransformSteps steps = transformSteps(transform);
+	// Size after the transform, before cropping
+	const uint width = trimmedLength(steps.transpose ? image->height : image->width, steps.flipHorizontal);
+	const uint height = trimmedLength(steps.transpose ? image->width : image->height, steps.flipVertical);
+	const uint blocksWide = (width + 7) / 8;
+	const uint blocksHigh = (height + 7) / 8;
+
+	const uint cropColumn = crop.x / 8;
+	const uint cropRow = crop.y / 8;
+	if (cropColumn * 8 >= width || cropRow * 8 >= height) {
+		std::cout << "Error: Crop region lies outside of the image\n";
+		return nullptr;
+	}
+	const uint maxWidth = width - cropColumn * 8;
+	const uint maxHeight = height - cropRow * 8;
+	// The region grows by what the corner moved, so it still ends where requested
+	const uint outWidth = (crop.width == 0) ? maxWidth : std::min(maxWidth, crop.width + crop.x % 8);
+	const uint outHeight = (crop.height == 0) ? maxHeight : std::min(maxHeight, crop.height + crop.y % 8);
+
+	CoefficientImage* out = new (std::nothrow) CoefficientImage;
+	if (out == nullptr) {
+		std::cout << "Error: Decoder error, coefficient image is null\n";
+		return nullptr;
+	}
+	out->width = outWidth;
+	out->height = outHeight;
+	out->numComponents = image->numComponents;
+	out->zigZagOrder = false;
+	for (uint i = 0; i < 4; ++i) {
+		out->quantizationTables[i] = image->quantizationTables[i];
+		if (steps.transpose) {
+			const QuantizationTable& source = image->quantizationTables[i];
+			for (uint k = 0; k < 64; ++k) {
+				out->quantizationTables[i].table[k] = source.table[(k % 8) * 8 + k / 8];
+			}
+		}
+	}
+
+	for (uint j = 0; j < image->numComponents; ++j) {
+		const CoefficientPlane& source = image->planes[j];
+		CoefficientPlane& plane = out->planes[j];
+		plane.blocksWide = (outWidth + 7) / 8;
+		plane.blocksHigh = (outHeight + 7) / 8;
+		plane.quantizationTableID = source.quantizationTableID;
+		plane.coefficients.assign((size_t)plane.blocksWide * plane.blocksHigh * 64, 0);
+		for (uint row = 0; row < plane.blocksHigh; ++row) {
+			for (uint column = 0; column < plane.blocksWide; ++column) {
+				// Back through the crop and the mirrors to the block of the transposed image, then to the source block
+				uint r = row + cropRow;
+				uint c = column + cropColumn;
+				r = steps.flipVertical ? blocksHigh - 1 - r : r;
+				c = steps.flipHorizontal ? blocksWide - 1 - c : c;
+				const uint sourceRow = steps.transpose ? c : r;
+				const uint sourceColumn = steps.transpose ? r : c;
+				transformBlock(&source.coefficients[((size_t)sourceRow * source.blocksWide + sourceColumn) * 64], plane.block(row, column), steps);
+			}
+		}
+	}
+	return out;
+}
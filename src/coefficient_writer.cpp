@@ -0,0 +1,34 @@
+#include "../include/jpeg.h"
+#include <iostream>
+#include <fstream>
+
+// Coefficient dump layout, little endian:
+//	"PCOF", width (long), height (long), component count (short), zig-zag order flag (short)
+//	per component: blocks wide (long), blocks high (long), 64 quantization values (short),
+//	then 64 coefficients (short, signed) per block in raster order
+void writeCoefficients(const std::string& savefile_name, const CoefficientImage* const image) {
+	std::ofstream outFile = std::ofstream(savefile_name, std::ios::out | std::ios::binary);
+	if (!outFile.is_open()) {
+		std::cout << "Error: Could not open output file\n";
+		return;
+	}
+
+	outFile.write("PCOF", 4);
+	putLong(outFile, image->width);
+	putLong(outFile, image->height);
+	putShort(outFile, image->numComponents);
+	putShort(outFile, image->zigZagOrder ? 1 : 0);
+	for (uint j = 0; j < image->numComponents; ++j) {
+		const CoefficientPlane& plane = image->planes[j];
+		putLong(outFile, plane.blocksWide);
+		putLong(outFile, plane.blocksHigh);
+		const QuantizationTable& qt = image->quantizationTables[plane.quantizationTableID];
+		for (uint k = 0; k < 64; ++k) {
+			putShort(outFile, qt.table[k]);
+		}
+		for (const int coefficient : plane.coefficients) {
+			putShort(outFile, (uint)coefficient);
+		}
+	}
+	outFile.close();
+}
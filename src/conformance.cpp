@@ -0,0 +1,667 @@
+#include "../include/jpeg.h"
+#include "../include/thread_pool.h"
+#include "../include/resampler.h"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+JPEGImage* parseJPEG(const std::string&);
+MCU* decodeHuffmanData(JPEGImage* const);
+GrayMCU* decodeGrayscaleData(JPEGImage* const);
+CoefficientImage* decodeCoefficients(JPEGImage* const, const bool);
+void dequantize(const JPEGImage* const, MCU* const, ThreadPool* const);
+void inverseDCT(const JPEGImage* const, MCU* const, ThreadPool* const, const uint);
+void convertToRGB(const JPEGImage*, MCU* const, ThreadPool* const);
+void reconstructGrayscale(const JPEGImage* const, GrayMCU* const, ThreadPool* const, const uint);
+void inverseDCTComp(int* const);
+void convertMCU_ToRGB(MCU&);
+void forwardDCTComp(float* const);
+void quantizationDivisors(const QuantizationTable&, float* const);
+
+typedef std::chrono::steady_clock Clock;
+
+// IEEE 1180 limits for an 8x8 IDCT
+const double idctPeakLimit = 1.0;
+const double idctPositionMSELimit = 0.06;
+const double idctOverallMSELimit = 0.02;
+const double idctPositionMeanLimit = 0.015;
+const double idctOverallMeanLimit = 0.0015;
+const uint idctTestBlocks = 10000;
+// Largest difference from the double precision pipeline allowed for any decoded corpus sample
+const double corpusPeakLimit = 2.0;
+// Largest difference from double precision filtering allowed for any resampled sample, float sums may round the other way
+const double resamplePeakLimit = 1.0;
+
+double secondsSince(const Clock::time_point start) {
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+std::string passFail(const bool pass) {
+	return pass ? "PASS" : "FAIL";
+}
+
+// C(u) / 2 * cos((2x + 1)u * pi / 16), the orthonormal 8 point DCT basis
+struct ReferenceDCTBasis {
+	double values[8][8];
+
+	ReferenceDCTBasis() {
+		for (uint x = 0; x < 8; ++x) {
+			for (uint u = 0; u < 8; ++u) {
+				const double scale = (u == 0) ? 1.0 / (2.0 * std::sqrt(2.0)) : 0.5;
+				values[x][u] = scale * std::cos((2.0 * x + 1.0) * u * U_PI / 16.0);
+			}
+		}
+	}
+};
+
+const ReferenceDCTBasis referenceBasis;
+
+// Double precision separable IDCT, natural order coefficients in, samples without level shift out
+void referenceIDCT(const double* const coefficients, double* const samples) {
+	double temp[64];
+	for (uint v = 0; v < 8; ++v) {
+		for (uint x = 0; x < 8; ++x) {
+			double sum = 0.0;
+			for (uint u = 0; u < 8; ++u) {
+				sum += referenceBasis.values[x][u] * coefficients[v * 8 + u];
+			}
+			temp[v * 8 + x] = sum;
+		}
+	}
+	for (uint y = 0; y < 8; ++y) {
+		for (uint x = 0; x < 8; ++x) {
+			double sum = 0.0;
+			for (uint v = 0; v < 8; ++v) {
+				sum += referenceBasis.values[y][v] * temp[v * 8 + x];
+			}
+			samples[y * 8 + x] = sum;
+		}
+	}
+}
+
+void referenceFDCT(const double* const samples, double* const coefficients) {
+	double temp[64];
+	for (uint y = 0; y < 8; ++y) {
+		for (uint u = 0; u < 8; ++u) {
+			double sum = 0.0;
+			for (uint x = 0; x < 8; ++x) {
+				sum += referenceBasis.values[x][u] * samples[y * 8 + x];
+			}
+			temp[y * 8 + u] = sum;
+		}
+	}
+	for (uint v = 0; v < 8; ++v) {
+		for (uint u = 0; u < 8; ++u) {
+			double sum = 0.0;
+			for (uint y = 0; y < 8; ++y) {
+				sum += referenceBasis.values[y][v] * temp[y * 8 + u];
+			}
+			coefficients[v * 8 + u] = sum;
+		}
+	}
+}
+
+int roundClamp(const double value, const int low, const int high) {
+	const int rounded = (int)std::floor(value + 0.5);
+	return std::min(std::max(rounded, low), high);
+}
+
+// JFIF YCbCr to RGB in double precision, inputs without level shift
+void referenceColor(const double y, const double cb, const double cr, int* const rgb) {
+	rgb[0] = roundClamp(y + 1.402 * cr + 128.0, 0, 255);
+	rgb[1] = roundClamp(y - 0.344136 * cb - 0.714136 * cr + 128.0, 0, 255);
+	rgb[2] = roundClamp(y + 1.772 * cb + 128.0, 0, 255);
+}
+
+// Random number generator from the IEEE 1180 test procedure, uniform integers in [-low, high]
+struct IEEE1180Random {
+	long long state = 1;
+
+	int next(const int low, const int high) {
+		state = (state * 1103515245LL + 12345LL) & 0xFFFFFFFFLL;
+		const long long i = state & 0x7FFFFFFE;
+		const double x = (double)i / (double)0x7FFFFFFF * (low + high + 1);
+		return (int)x - low;
+	}
+};
+
+// Error statistics of one IEEE 1180 run
+struct IDCTAccuracy {
+	double peak = 0.0;
+	double worstPositionMSE = 0.0;
+	double overallMSE = 0.0;
+	double worstPositionMean = 0.0;
+	double overallMean = 0.0;
+	double seconds = 0.0;
+
+	bool pass() const {
+		return peak <= idctPeakLimit && worstPositionMSE <= idctPositionMSELimit && overallMSE <= idctOverallMSELimit &&
+			worstPositionMean <= idctPositionMeanLimit && std::fabs(overallMean) <= idctOverallMeanLimit;
+	}
+};
+
+IDCTAccuracy measureIDCT(void (*const idct)(int* const), const int low, const int high, const int sign) {
+	IEEE1180Random random;
+	double errorSum[64] = { 0.0 };
+	double squaredErrorSum[64] = { 0.0 };
+	IDCTAccuracy accuracy;
+	std::vector<int> blocks((size_t)idctTestBlocks * 64);
+	std::vector<double> references((size_t)idctTestBlocks * 64);
+	for (uint n = 0; n < idctTestBlocks; ++n) {
+		double samples[64];
+		for (uint i = 0; i < 64; ++i) {
+			samples[i] = sign * random.next(low, high);
+		}
+		double coefficients[64];
+		referenceFDCT(samples, coefficients);
+		int* const quantized = &blocks[(size_t)n * 64];
+		for (uint i = 0; i < 64; ++i) {
+			quantized[i] = roundClamp(coefficients[i], -2048, 2047);
+			coefficients[i] = quantized[i];
+		}
+		referenceIDCT(coefficients, &references[(size_t)n * 64]);
+	}
+
+	// The whole batch is timed at once, a clock read per block would cost about as much as the block
+	const Clock::time_point start = Clock::now();
+	for (uint n = 0; n < idctTestBlocks; ++n) {
+		idct(&blocks[(size_t)n * 64]);
+	}
+	accuracy.seconds = secondsSince(start);
+
+	for (uint n = 0; n < idctTestBlocks; ++n) {
+		const int* const quantized = &blocks[(size_t)n * 64];
+		const double* const reference = &references[(size_t)n * 64];
+		for (uint i = 0; i < 64; ++i) {
+			const double error = std::min(std::max(quantized[i], -256), 255) - roundClamp(reference[i], -256, 255);
+			accuracy.peak = std::max(accuracy.peak, std::fabs(error));
+			errorSum[i] += error;
+			squaredErrorSum[i] += error * error;
+		}
+	}
+	double totalError = 0.0;
+	double totalSquaredError = 0.0;
+	for (uint i = 0; i < 64; ++i) {
+		accuracy.worstPositionMSE = std::max(accuracy.worstPositionMSE, squaredErrorSum[i] / idctTestBlocks);
+		accuracy.worstPositionMean = std::max(accuracy.worstPositionMean, std::fabs(errorSum[i] / idctTestBlocks));
+		totalError += errorSum[i];
+		totalSquaredError += squaredErrorSum[i];
+	}
+	accuracy.overallMSE = totalSquaredError / (64.0 * idctTestBlocks);
+	accuracy.overallMean = totalError / (64.0 * idctTestBlocks);
+	return accuracy;
+}
+
+// zigZagMap must be the Annex A zig-zag walk, and the Annex K tables must be self consistent
+bool checkTables() {
+	bool pass = true;
+	byte expected[64];
+	uint index = 0;
+	for (uint sum = 0; sum < 15; ++sum) {
+		for (uint step = 0; step <= sum; ++step) {
+			// Odd diagonals run down to the left, even diagonals up to the right
+			const uint row = (sum % 2 == 1) ? step : sum - step;
+			const uint col = sum - row;
+			if (row < 8 && col < 8) {
+				expected[index++] = (byte)(row * 8 + col);
+			}
+		}
+	}
+	for (uint i = 0; i < 64; ++i) {
+		if (zigZagMap[i] != expected[i]) {
+			std::cout << "  zigZagMap[" << i << "] is " << (uint)zigZagMap[i] << ", expected " << (uint)expected[i] << "\n";
+			pass = false;
+		}
+	}
+	std::cout << "  zigZagMap matches the Annex A zig-zag order ........ " << passFail(pass) << "\n";
+
+	uint dcLuminance = 0;
+	uint acLuminance = 0;
+	uint dcChrominance = 0;
+	uint acChrominance = 0;
+	for (uint i = 0; i < 16; ++i) {
+		dcLuminance += standardDCLuminanceCounts[i];
+		acLuminance += standardACLuminanceCounts[i];
+		dcChrominance += standardDCChrominanceCounts[i];
+		acChrominance += standardACChrominanceCounts[i];
+	}
+	const bool huffmanPass = dcLuminance == 12 && dcChrominance == 12 && acLuminance == 162 && acChrominance == 162;
+	std::cout << "  Annex K Huffman table symbol counts ................ " << passFail(huffmanPass) << "\n";
+	const bool quantizationPass = standardLuminanceQuantization[0] == 16 && standardLuminanceQuantization[1] == 11 &&
+		standardLuminanceQuantization[8] == 12 && standardChrominanceQuantization[1] == 18 && standardChrominanceQuantization[8] == 18;
+	std::cout << "  Annex K quantization tables in natural order ....... " << passFail(quantizationPass) << "\n";
+	return pass && huffmanPass && quantizationPass;
+}
+
+bool checkIDCT() {
+	const int ranges[3][2] = { { 256, 255 }, { 5, 5 }, { 300, 300 } };
+	bool pass = true;
+	std::cout << "  variant     range         peak  pos mse  all mse  pos mean  all mean   Mblocks/s\n";
+	for (uint r = 0; r < 3; ++r) {
+		for (int sign = 1; sign >= -1; sign -= 2) {
+			const IDCTAccuracy accuracy = measureIDCT(inverseDCTComp, ranges[r][0], ranges[r][1], sign);
+			std::ostringstream range;
+			range << (sign > 0 ? "" : "-") << "[" << -ranges[r][0] << "," << ranges[r][1] << "]";
+			std::cout << "  AAN float   " << std::left << std::setw(12) << range.str() << std::right << std::fixed
+				<< std::setw(6) << std::setprecision(0) << accuracy.peak
+				<< std::setw(9) << std::setprecision(4) << accuracy.worstPositionMSE
+				<< std::setw(9) << accuracy.overallMSE
+				<< std::setw(10) << accuracy.worstPositionMean
+				<< std::setw(10) << accuracy.overallMean
+				<< std::setw(12) << std::setprecision(1) << idctTestBlocks / accuracy.seconds / 1e6
+				<< "  " << passFail(accuracy.pass()) << "\n";
+			pass = pass && accuracy.pass();
+		}
+	}
+
+	// An all zero block has to come back as all zeros
+	int zeros[64] = { 0 };
+	inverseDCTComp(zeros);
+	const bool zeroPass = std::all_of(zeros, zeros + 64, [](int value) { return value == 0; });
+	std::cout << "  AAN float   zero block in, zero block out .......... " << passFail(zeroPass) << "\n";
+	return pass && zeroPass;
+}
+
+// The encoder's forward DCT, unscaled through unit quantization divisors, against the double precision FDCT
+bool checkFDCT() {
+	QuantizationTable unit;
+	for (uint i = 0; i < 64; ++i) {
+		unit.table[i] = 1;
+	}
+	float divisors[64];
+	quantizationDivisors(unit, divisors);
+
+	IEEE1180Random random;
+	std::vector<float> blocks((size_t)idctTestBlocks * 64);
+	std::vector<double> references((size_t)idctTestBlocks * 64);
+	for (uint n = 0; n < idctTestBlocks; ++n) {
+		double samples[64];
+		for (uint i = 0; i < 64; ++i) {
+			samples[i] = random.next(128, 127);
+			blocks[(size_t)n * 64 + i] = (float)samples[i];
+		}
+		referenceFDCT(samples, &references[(size_t)n * 64]);
+	}
+	const Clock::time_point start = Clock::now();
+	for (uint n = 0; n < idctTestBlocks; ++n) {
+		forwardDCTComp(&blocks[(size_t)n * 64]);
+	}
+	const double seconds = secondsSince(start);
+	double peak = 0.0;
+	for (size_t i = 0; i < blocks.size(); ++i) {
+		peak = std::max(peak, std::fabs(blocks[i] * divisors[i % 64] - references[i]));
+	}
+	// Below half a step the quantized coefficient is off by at most one
+	const bool pass = peak < 0.5;
+	std::cout << "  AAN float forward DCT   peak " << std::fixed << std::setprecision(4) << peak
+		<< "   " << std::setprecision(1) << idctTestBlocks / seconds / 1e6 << " Mblocks/s  " << passFail(pass) << "\n";
+	return pass;
+}
+
+bool checkColorConversion() {
+	std::vector<MCU> mcus;
+	std::vector<int> expected;
+	MCU mcu;
+	uint filled = 0;
+	for (int y = -128; y < 128; y += 3) {
+		for (int cb = -128; cb < 128; cb += 3) {
+			for (int cr = -128; cr < 128; cr += 3) {
+				mcu.y[filled] = y;
+				mcu.cb[filled] = cb;
+				mcu.cr[filled] = cr;
+				int rgb[3];
+				referenceColor(y, cb, cr, rgb);
+				expected.insert(expected.end(), rgb, rgb + 3);
+				filled += 1;
+				if (filled == 64) {
+					mcus.push_back(mcu);
+					filled = 0;
+				}
+			}
+		}
+	}
+	expected.resize(mcus.size() * 64 * 3);
+
+	const Clock::time_point start = Clock::now();
+	for (MCU& block : mcus) {
+		convertMCU_ToRGB(block);
+	}
+	const double seconds = secondsSince(start);
+
+	double peak = 0.0;
+	double squaredError = 0.0;
+	const uint samples = (uint)mcus.size() * 64;
+	for (uint i = 0; i < samples; ++i) {
+		const MCU& block = mcus[i / 64];
+		const int actual[3] = { block.r[i % 64], block.g[i % 64], block.b[i % 64] };
+		for (uint c = 0; c < 3; ++c) {
+			const double error = actual[c] - expected[(size_t)i * 3 + c];
+			peak = std::max(peak, std::fabs(error));
+			squaredError += error * error;
+		}
+	}
+	const double mse = squaredError / (samples * 3.0);
+	const double psnr = (mse == 0.0) ? 99.0 : 10.0 * std::log10(255.0 * 255.0 / mse);
+	const bool pass = peak <= 1.0;
+	std::cout << "  float YCbCr->RGB   PSNR " << std::fixed << std::setprecision(1) << psnr << " dB   max " << std::setprecision(0) << peak
+		<< "   " << std::setprecision(1) << samples / seconds / 1e6 << " Mpixels/s  " << passFail(pass) << "\n";
+	return pass;
+}
+
+// Double precision scaled IDCT: the lowest size x size coefficients through a size point IDCT that keeps the 8 point
+// normalization, so the samples stay at the block's level. Natural order coefficients in, size x size samples out.
+void referenceReducedIDCT(const double* const coefficients, double* const samples, const uint size) {
+	if (size == 8) {
+		referenceIDCT(coefficients, samples);
+		return;
+	}
+	for (uint y = 0; y < size; ++y) {
+		for (uint x = 0; x < size; ++x) {
+			double sum = 0.0;
+			for (uint v = 0; v < size; ++v) {
+				for (uint u = 0; u < size; ++u) {
+					const double scaleU = (u == 0) ? 1.0 / (2.0 * std::sqrt(2.0)) : 0.5;
+					const double scaleV = (v == 0) ? 1.0 / (2.0 * std::sqrt(2.0)) : 0.5;
+					sum += scaleU * scaleV * std::cos((2.0 * x + 1.0) * u * U_PI / (2.0 * size)) *
+						std::cos((2.0 * y + 1.0) * v * U_PI / (2.0 * size)) * coefficients[v * 8 + u];
+				}
+			}
+			samples[y * size + x] = sum;
+		}
+	}
+}
+
+// Double precision decode of the entropy decoded coefficients over the whole padded block grid, every block
+// reduced to size x size pixels, channels interleaved per pixel
+std::vector<double> referenceDecode(CoefficientImage* const image, const uint size) {
+	const uint channels = (image->numComponents == 1) ? 1 : 3;
+	const uint width = image->planes[0].blocksWide * size;
+	const uint height = image->planes[0].blocksHigh * size;
+	std::vector<double> samples[3];
+	for (uint c = 0; c < image->numComponents; ++c) {
+		CoefficientPlane& plane = image->planes[c];
+		const QuantizationTable& qt = image->quantizationTables[plane.quantizationTableID];
+		samples[c].assign((size_t)width * height, 0.0);
+		for (uint row = 0; row < plane.blocksHigh; ++row) {
+			for (uint col = 0; col < plane.blocksWide; ++col) {
+				const int* const block = plane.block(row, col);
+				double coefficients[64];
+				double pixels[64];
+				for (uint i = 0; i < 64; ++i) {
+					coefficients[i] = (double)block[i] * qt.table[i];
+				}
+				referenceReducedIDCT(coefficients, pixels, size);
+				for (uint y = 0; y < size; ++y) {
+					for (uint x = 0; x < size; ++x) {
+						samples[c][((size_t)row * size + y) * width + col * size + x] = pixels[y * size + x];
+					}
+				}
+			}
+		}
+	}
+
+	std::vector<double> pixels((size_t)width * height * channels);
+	for (size_t i = 0; i < (size_t)width * height; ++i) {
+		double* const out = &pixels[i * channels];
+		if (channels == 1) {
+			out[0] = roundClamp(samples[0][i] + 128.0, 0, 255);
+			continue;
+		}
+		int rgb[3];
+		referenceColor(samples[0][i], samples[1][i], samples[2][i], rgb);
+		out[0] = rgb[0];
+		out[1] = rgb[1];
+		out[2] = rgb[2];
+	}
+	return pixels;
+}
+
+struct ImageError {
+	double psnr = 99.0;
+	double peak = 0.0;
+};
+
+int blockSample(const MCU& mcu, uint pixelID, uint channel) {
+	return (channel == 0) ? mcu.r[pixelID] : (channel == 1) ? mcu.g[pixelID] : mcu.b[pixelID];
+}
+
+int blockSample(const GrayMCU& block, uint pixelID, uint) {
+	return block.y[pixelID];
+}
+
+template <typename Block>
+ImageError compareBlocks(const std::vector<double>& reference, const Block* const blocks, const JPEGImage* const jpeg, uint channels, uint blockSize) {
+	const uint factor = 8 / blockSize;
+	const uint width = (jpeg->width + factor - 1) / factor;
+	const uint height = (jpeg->height + factor - 1) / factor;
+	const uint mcuCols = (jpeg->width + 7) / 8;
+	// The reference covers whole blocks, only the pixels inside the image are compared
+	const uint referenceWidth = mcuCols * blockSize;
+	ImageError error;
+	double squaredError = 0.0;
+	for (uint y = 0; y < height; ++y) {
+		for (uint x = 0; x < width; ++x) {
+			const Block& block = blocks[(y / blockSize) * mcuCols + x / blockSize];
+			const uint pixelID = (y % blockSize) * 8 + x % blockSize;
+			for (uint c = 0; c < channels; ++c) {
+				const double difference = blockSample(block, pixelID, c) - reference[((size_t)y * referenceWidth + x) * channels + c];
+				error.peak = std::max(error.peak, std::fabs(difference));
+				squaredError += difference * difference;
+			}
+		}
+	}
+	const double mse = squaredError / ((double)width * height * channels);
+	error.psnr = (mse == 0.0) ? 99.0 : std::min(99.0, 10.0 * std::log10(255.0 * 255.0 / mse));
+	return error;
+}
+
+void printVariant(const std::string& name, const ImageError& error, double megapixels, double seconds) {
+	const bool pass = error.peak <= corpusPeakLimit;
+	std::cout << "    " << std::left << std::setw(22) << name << std::right << std::fixed
+		<< "PSNR " << std::setw(5) << std::setprecision(1) << error.psnr << " dB   max "
+		<< std::setw(3) << std::setprecision(0) << error.peak << "   "
+		<< std::setw(7) << std::setprecision(1) << megapixels / seconds << " Mpixels/s  " << passFail(pass) << "\n";
+}
+
+// Decodes one corpus image through every pixel path and compares each with the double precision pipeline
+bool checkCorpusImage(const std::string& filename, ThreadPool& pool) {
+	JPEGImage* jpeg = parseJPEG(filename);
+	if (jpeg == nullptr || !jpeg->isValid) {
+		// Progressive and other unsupported files are left out of the corpus rather than failing it
+		std::cout << "  " << filename << ": not a supported JPEG, skipped\n";
+		delete jpeg;
+		return true;
+	}
+	CoefficientImage* coefficients = decodeCoefficients(jpeg, false);
+	if (coefficients == nullptr) {
+		delete jpeg;
+		return false;
+	}
+	const uint channels = (jpeg->numComponents == 1) ? 1 : 3;
+	std::cout << "  " << filename << " (" << jpeg->width << "x" << jpeg->height << ", " << (uint)jpeg->numComponents << " components)\n";
+
+	bool pass = true;
+	const uint blockSizes[4] = { 8, 4, 2, 1 };
+	for (uint s = 0; s < 4; ++s) {
+		const uint blockSize = blockSizes[s];
+		const uint factor = 8 / blockSize;
+		const std::vector<double> expected = referenceDecode(coefficients, blockSize);
+		const std::string scale = (factor == 1) ? "" : " 1/" + std::to_string(factor);
+		const double megapixels = (double)jpeg->width * jpeg->height / 1e6;
+
+		Clock::time_point start = Clock::now();
+		MCU* mcus = decodeHuffmanData(jpeg);
+		if (mcus == nullptr) {
+			pass = false;
+			break;
+		}
+		dequantize(jpeg, mcus, &pool);
+		inverseDCT(jpeg, mcus, &pool, blockSize);
+		convertToRGB(jpeg, mcus, &pool);
+		double seconds = secondsSince(start);
+		const ImageError error = compareBlocks(expected, mcus, jpeg, channels, blockSize);
+		printVariant("AAN float" + scale, error, megapixels, seconds);
+		delete[] mcus;
+		// Every scale has to stay within rounding of the reference, samples and colors are rounded separately
+		pass = pass && error.peak <= corpusPeakLimit;
+
+		if (channels == 1) {
+			start = Clock::now();
+			GrayMCU* blocks = decodeGrayscaleData(jpeg);
+			if (blocks == nullptr) {
+				pass = false;
+				break;
+			}
+			reconstructGrayscale(jpeg, blocks, &pool, blockSize);
+			seconds = secondsSince(start);
+			const ImageError grayError = compareBlocks(expected, blocks, jpeg, 1, blockSize);
+			printVariant("grayscale" + scale, grayError, megapixels, seconds);
+			delete[] blocks;
+			pass = pass && grayError.peak <= corpusPeakLimit;
+		}
+	}
+	delete coefficients;
+	delete jpeg;
+	return pass;
+}
+
+// Filter kernels and supports as the resampler defines them
+double referenceFilter(ResampleFilter filter, double x) {
+	const auto sinc = [](double t) { return (t == 0.0) ? 1.0 : std::sin(t * U_PI) / (t * U_PI); };
+	switch (filter) {
+	case ResampleFilter::Box:
+		return (x >= -0.5 && x < 0.5) ? 1.0 : 0.0;
+	case ResampleFilter::Bilinear:
+		return (std::fabs(x) < 1.0) ? 1.0 - std::fabs(x) : 0.0;
+	default:
+		return (x > -3.0 && x < 3.0) ? sinc(x) * sinc(x / 3.0) : 0.0;
+	}
+}
+
+// Normalized weight of every source pixel for every target pixel of one axis, targetSize rows of size weights.
+// Downscaling stretches the filter over the scale factor, pixel centers sit at half integers.
+std::vector<double> referenceResampleWeights(uint size, uint targetSize, ResampleFilter filter) {
+	const double scale = (double)size / targetSize;
+	const double filterScale = std::max(scale, 1.0);
+	std::vector<double> weights((size_t)targetSize * size, 0.0);
+	for (uint i = 0; i < targetSize; ++i) {
+		const double center = (i + 0.5) * scale;
+		double total = 0.0;
+		for (uint k = 0; k < size; ++k) {
+			const double weight = referenceFilter(filter, (k + 0.5 - center) / filterScale);
+			weights[(size_t)i * size + k] = weight;
+			total += weight;
+		}
+		for (uint k = 0; total != 0.0 && k < size; ++k) {
+			weights[(size_t)i * size + k] /= total;
+		}
+	}
+	return weights;
+}
+
+// Resamples one synthetic image through Resampler and compares it with separable double precision filtering
+bool checkResample(const std::vector<byte>& source, uint width, uint height, uint channels, uint targetWidth, uint targetHeight,
+	ResampleFilter filter) {
+	std::vector<byte> actual((size_t)targetWidth * targetHeight * channels);
+	const Clock::time_point start = Clock::now();
+	Resampler resampler(width, height, targetWidth, targetHeight, channels, filter);
+	for (uint y = 0; y < height; ++y) {
+		resampler.pushRow(&source[(size_t)y * width * channels], [&actual, targetWidth, channels](uint row, const byte* const pixels) {
+			std::copy(pixels, pixels + (size_t)targetWidth * channels, actual.begin() + (size_t)row * targetWidth * channels);
+		});
+	}
+	const double seconds = secondsSince(start);
+
+	const std::vector<double> horizontal = referenceResampleWeights(width, targetWidth, filter);
+	const std::vector<double> vertical = referenceResampleWeights(height, targetHeight, filter);
+	std::vector<double> rows((size_t)height * targetWidth * channels, 0.0);
+	for (uint y = 0; y < height; ++y) {
+		for (uint i = 0; i < targetWidth; ++i) {
+			for (uint k = 0; k < width; ++k) {
+				const double weight = horizontal[(size_t)i * width + k];
+				for (uint c = 0; weight != 0.0 && c < channels; ++c) {
+					rows[((size_t)y * targetWidth + i) * channels + c] += weight * source[((size_t)y * width + k) * channels + c];
+				}
+			}
+		}
+	}
+	ImageError error;
+	double squaredError = 0.0;
+	for (uint j = 0; j < targetHeight; ++j) {
+		for (size_t i = 0; i < (size_t)targetWidth * channels; ++i) {
+			double sum = 0.0;
+			for (uint y = 0; y < height; ++y) {
+				sum += vertical[(size_t)j * height + y] * rows[(size_t)y * targetWidth * channels + i];
+			}
+			const double difference = actual[(size_t)j * targetWidth * channels + i] - roundClamp(sum, 0, 255);
+			error.peak = std::max(error.peak, std::fabs(difference));
+			squaredError += difference * difference;
+		}
+	}
+	const double mse = squaredError / ((double)targetWidth * targetHeight * channels);
+	error.psnr = (mse == 0.0) ? 99.0 : std::min(99.0, 10.0 * std::log10(255.0 * 255.0 / mse));
+
+	const char* const filters[] = { "box", "bilinear", "lanczos" };
+	std::ostringstream name;
+	name << filters[(int)filter] << " " << width << "x" << height << "->" << targetWidth << "x" << targetHeight << (channels == 1 ? " gray" : " rgb");
+	const bool pass = error.peak <= resamplePeakLimit;
+	std::cout << "  " << std::left << std::setw(32) << name.str() << std::right << std::fixed
+		<< "PSNR " << std::setw(5) << std::setprecision(1) << error.psnr << " dB   max "
+		<< std::setw(3) << std::setprecision(0) << error.peak << "   "
+		<< std::setw(7) << std::setprecision(1) << (double)width * height / seconds / 1e6 << " Mpixels/s  " << passFail(pass) << "\n";
+	return pass;
+}
+
+// Every filter down and up on a gradient with noise, whose edges and texture exercise the negative Lanczos lobes
+bool checkResampler() {
+	const uint width = 331;
+	const uint height = 229;
+	IEEE1180Random random;
+	bool pass = true;
+	const uint channelCounts[2] = { 3, 1 };
+	for (const uint channels : channelCounts) {
+		std::vector<byte> source((size_t)width * height * channels);
+		for (uint y = 0; y < height; ++y) {
+			for (uint x = 0; x < width; ++x) {
+				for (uint c = 0; c < channels; ++c) {
+					const int level = (int)((x * 255 / width + y * 255 / height) / 2) + ((x / 16 + y / 16 + c) % 2 == 0 ? 40 : -40);
+					source[((size_t)y * width + x) * channels + c] = (byte)roundClamp(level + random.next(30, 30), 0, 255);
+				}
+			}
+		}
+		const ResampleFilter filters[3] = { ResampleFilter::Box, ResampleFilter::Bilinear, ResampleFilter::Lanczos };
+		for (const ResampleFilter filter : filters) {
+			pass = checkResample(source, width, height, channels, 97, 61, filter) && pass;
+			pass = checkResample(source, width, height, channels, 500, 347, filter) && pass;
+		}
+	}
+	return pass;
+}
+
+// Runs the table, IDCT, FDCT, color conversion and resampler checks, then every pixel path over the corpus.
+// Returns false when any check fails its accuracy bound.
+bool runConformance(const std::vector<std::string>& corpus, ThreadPool& pool) {
+	std::cout << "Tables\n";
+	bool pass = checkTables();
+	std::cout << "\nIDCT (IEEE 1180, " << idctTestBlocks << " blocks per range)\n";
+	pass = checkIDCT() && pass;
+	std::cout << "\nForward DCT\n";
+	pass = checkFDCT() && pass;
+	std::cout << "\nColor conversion\n";
+	pass = checkColorConversion() && pass;
+	std::cout << "\nResampler against double precision filtering\n";
+	pass = checkResampler() && pass;
+	if (!corpus.empty()) {
+		std::cout << "\nCorpus against the double precision pipeline\n";
+	}
+	for (const std::string& filename : corpus) {
+		pass = checkCorpusImage(filename, pool) && pass;
+	}
+	std::cout << "\nConformance " << (pass ? "passed" : "FAILED") << "\n";
+	return pass;
+}
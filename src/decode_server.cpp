@@ -0,0 +1,176 @@
+#include "../include/utils.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <functional>
+
+#ifndef _WIN32
+#define DECODE_SERVER_SOCKET
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <csignal>
+#endif
+
+typedef std::function<std::string(const std::string&)> RequestHandler;
+
+const std::string shutdownRequest = "shutdown";
+
+// Answers newline delimited requests from stdin until it closes or a shutdown request arrives.
+// Responses go to stdout, so decoder logging is moved to stderr while serving.
+void serveStdin(const RequestHandler& handle) {
+	std::ostream responses(std::cout.rdbuf());
+	std::streambuf* const logBuffer = std::cout.rdbuf(std::cerr.rdbuf());
+	std::string line;
+	while (std::getline(std::cin, line)) {
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+		if (line == shutdownRequest) {
+			break;
+		}
+		if (!line.empty()) {
+			responses << handle(line) << std::endl;
+		}
+	}
+	std::cout.rdbuf(logBuffer);
+}
+
+#ifdef DECODE_SERVER_SOCKET
+
+const size_t socketReadSize = 4096;
+const size_t maxRequestLength = 64 * 1024;
+
+struct Client {
+	int fd;
+	std::string pending; // bytes received after the last complete request
+};
+
+bool sendAll(int fd, const std::string& data) {
+	size_t sent = 0;
+	while (sent < data.size()) {
+		const ssize_t result = send(fd, data.data() + sent, data.size() - sent, 0);
+		if (result < 0 && errno == EINTR) {
+			continue;
+		}
+		if (result <= 0) {
+			return false;
+		}
+		sent += (size_t)result;
+	}
+	return true;
+}
+
+// Reads what the client sent and answers every complete request line in it.
+// Returns false when the connection should be closed, sets stop on a shutdown request.
+bool serveClient(Client& client, const RequestHandler& handle, bool& stop) {
+	char buffer[socketReadSize];
+	const ssize_t received = recv(client.fd, buffer, sizeof(buffer), 0);
+	if (received < 0 && errno == EINTR) {
+		return true;
+	}
+	if (received <= 0) {
+		return false;
+	}
+	client.pending.append(buffer, (size_t)received);
+	size_t end;
+	while ((end = client.pending.find('\n')) != std::string::npos) {
+		std::string line = client.pending.substr(0, end);
+		client.pending.erase(0, end + 1);
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+		if (line == shutdownRequest) {
+			stop = true;
+			return false;
+		}
+		if (!line.empty() && !sendAll(client.fd, handle(line) + "\n")) {
+			return false;
+		}
+	}
+	if (client.pending.size() > maxRequestLength) {
+		sendAll(client.fd, "error Request too long\n");
+		return false;
+	}
+	return true;
+}
+
+// Listens on a UNIX domain socket and answers newline delimited requests from any number of clients.
+// Requests are handled one at a time in arrival order, so decodes keep the whole warm thread pool to themselves.
+bool serveSocket(const std::string& socketPath, const RequestHandler& handle) {
+	sockaddr_un address;
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (socketPath.size() >= sizeof(address.sun_path)) {
+		std::cout << "Error: Socket path " + socketPath + " is too long\n";
+		return false;
+	}
+	std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+	const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0) {
+		std::cout << "Error: Could not create socket\n";
+		return false;
+	}
+	// A socket file left behind by an earlier server would make bind fail
+	unlink(socketPath.c_str());
+	if (bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0) {
+		std::cout << "Error: Could not listen on " + socketPath + "\n";
+		close(listener);
+		return false;
+	}
+	// A client hanging up before its response is written must not kill the server
+	signal(SIGPIPE, SIG_IGN);
+	std::cout << "Listening on " + socketPath + "\n";
+
+	std::vector<Client> clients;
+	bool stop = false;
+	while (!stop) {
+		std::vector<pollfd> watched(1 + clients.size());
+		watched[0].fd = listener;
+		watched[0].events = POLLIN;
+		for (size_t i = 0; i < clients.size(); ++i) {
+			watched[i + 1].fd = clients[i].fd;
+			watched[i + 1].events = POLLIN;
+		}
+		if (poll(watched.data(), watched.size(), -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		for (size_t i = clients.size(); i > 0 && !stop; --i) {
+			if (watched[i].revents == 0) {
+				continue;
+			}
+			if (!serveClient(clients[i - 1], handle, stop)) {
+				close(clients[i - 1].fd);
+				clients.erase(clients.begin() + (i - 1));
+			}
+		}
+		if (!stop && (watched[0].revents & POLLIN) != 0) {
+			const int fd = accept(listener, nullptr, nullptr);
+			if (fd >= 0) {
+				clients.push_back(Client{ fd, std::string() });
+			}
+		}
+	}
+	for (const Client& client : clients) {
+		close(client.fd);
+	}
+	close(listener);
+	unlink(socketPath.c_str());
+	return true;
+}
+
+#else
+
+bool serveSocket(const std::string&, const RequestHandler&) {
+	std::cout << "Error: UNIX domain sockets are not supported on this platform, use --serve for stdin requests\n";
+	return false;
+}
+
+#endif
@@ -3,10 +3,4 @@
 void ErrorHandler::logJPEGError(const std::string& message, bool& isValid) {
 	std::cout << message;
 	isValid = false;
-}
-
-void ErrorHandler::logJPEGError(const std::string& message, bool& isValid, std::ifstream& inFile) {
-	std::cout << message;
-	isValid = false;
-	inFile.close();
 }
\ No newline at end of file
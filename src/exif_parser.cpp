@@ -0,0 +1,95 @@
+#include "../include/jpeg.h"
+#include <algorithm>
+
+const uint exifOrientation = 0x0112;
+const uint exifThumbnailCompression = 0x0103;
+const uint exifThumbnailOffset = 0x0201;
+const uint exifThumbnailLength = 0x0202;
+
+// Bounds checked reads from a TIFF structure in either byte order
+struct TIFFReader {
+	const byte* data;
+	size_t length;
+	bool bigEndian;
+
+	bool valid(size_t offset, size_t size) const {
+		return offset <= length && size <= length - offset;
+	}
+	uint read16(size_t offset) const {
+		return bigEndian ? (data[offset] << 8) | data[offset + 1] : data[offset] | (data[offset + 1] << 8);
+	}
+	uint read32(size_t offset) const {
+		return bigEndian ? (read16(offset) << 16) | read16(offset + 2) : read16(offset) | (read16(offset + 2) << 16);
+	}
+	// Value of a SHORT or LONG entry, both fit in the 4 value bytes of the entry
+	uint entryValue(size_t entry) const {
+		return (read16(entry + 2) == 3) ? read16(entry + 8) : read32(entry + 8);
+	}
+};
+
+// Walks the IFD at offset, returns the offset of the next IFD or 0 when this was the last one
+uint readIFD(const TIFFReader& tiff, uint offset, ExifData& exif, bool thumbnailIFD) {
+	if (!tiff.valid(offset, 2)) {
+		return 0;
+	}
+	const uint entries = tiff.read16(offset);
+	if (!tiff.valid(offset + 2, entries * 12 + 4)) {
+		return 0;
+	}
+	uint thumbnailOffset = 0;
+	uint thumbnailLength = 0;
+	uint compression = 6;
+	for (uint i = 0; i < entries; ++i) {
+		const size_t entry = offset + 2 + i * 12;
+		const uint tag = tiff.read16(entry);
+		if (!thumbnailIFD && tag == exifOrientation) {
+			const uint orientation = tiff.entryValue(entry);
+			if (orientation >= 1 && orientation <= 8) {
+				exif.orientation = (byte)orientation;
+			}
+		}
+		else if (thumbnailIFD && tag == exifThumbnailOffset) {
+			thumbnailOffset = tiff.entryValue(entry);
+		}
+		else if (thumbnailIFD && tag == exifThumbnailLength) {
+			thumbnailLength = tiff.entryValue(entry);
+		}
+		else if (thumbnailIFD && tag == exifThumbnailCompression) {
+			compression = tiff.entryValue(entry);
+		}
+	}
+	// Compression 6 is the JPEG thumbnail, uncompressed strip thumbnails are left alone
+	if (thumbnailIFD && compression == 6 && thumbnailLength != 0 && tiff.valid(thumbnailOffset, thumbnailLength)) {
+		exif.thumbnail.assign(tiff.data + thumbnailOffset, tiff.data + thumbnailOffset + thumbnailLength);
+	}
+	return tiff.read32(offset + 2 + entries * 12);
+}
+
+// Parses the payload of an APP1 segment, non EXIF payloads (e.g. XMP) and repeated EXIF segments are ignored
+void parseExif(const std::vector<byte>& payload, ExifData& exif) {
+	const byte header[6] = { 'E', 'x', 'i', 'f', 0, 0 };
+	if (exif.found || payload.size() < 14 || !std::equal(header, header + 6, payload.begin())) {
+		return;
+	}
+	exif.found = true;
+	TIFFReader tiff;
+	tiff.data = payload.data() + 6;
+	tiff.length = payload.size() - 6;
+	if (tiff.data[0] == 'M' && tiff.data[1] == 'M') {
+		tiff.bigEndian = true;
+	}
+	else if (tiff.data[0] == 'I' && tiff.data[1] == 'I') {
+		tiff.bigEndian = false;
+	}
+	else {
+		return;
+	}
+	if (tiff.read16(2) != 42) {
+		return;
+	}
+	const uint firstIFD = tiff.read32(4);
+	const uint secondIFD = readIFD(tiff, firstIFD, exif, false);
+	if (secondIFD != 0 && secondIFD != firstIFD) {
+		readIFD(tiff, secondIFD, exif, true);
+	}
+}
@@ -0,0 +1,187 @@
+#include "../include/frame_decoder.h"
+#include "../include/byte_reader.h"
+#include "../include/bit_reader.h"
+#include <iostream>
+#include <algorithm>
+
+void parseHeaders(ByteReader&, JPEGImage* const);
+void parseScanData(ByteReader&, JPEGImage* const);
+void generateAllHuffmanCodes(JPEGImage* const);
+bool decodeMCURange(BitReader&, const JPEGImage* const, int* const, MCU* const, uint, uint, const bool);
+void reconstructMCUs(const JPEGImage* const, MCU* const, uint, const uint);
+
+FrameDecoder::FrameDecoder(ThreadPool& pool, const FrameCallback& onFrame) :
+	pool(pool), onFrame(onFrame), searchFrom(0), frameCount(0), decodedCount(0), failedCount(0), reusedCount(0) {}
+
+void FrameDecoder::push(const byte* const data, size_t length) {
+	buffer.insert(buffer.end(), data, data + length);
+	const size_t consumed = decodeFrames(buffer, false);
+	buffer.erase(buffer.begin(), buffer.begin() + consumed);
+}
+
+void FrameDecoder::finish() {
+	decodeFrames(buffer, true);
+	buffer.clear();
+	searchFrom = 0;
+}
+
+void FrameDecoder::decodeBuffer(const std::vector<byte>& data) {
+	searchFrom = 0;
+	decodeFrames(data, true);
+	searchFrom = 0;
+}
+
+uint FrameDecoder::framesDecoded() const {
+	return decodedCount;
+}
+
+uint FrameDecoder::framesFailed() const {
+	return failedCount;
+}
+
+uint FrameDecoder::headersReused() const {
+	return reusedCount;
+}
+
+// Decodes the frames in data, returns how many leading bytes are done with. Unless final, a frame missing
+// its end is left for the next call.
+size_t FrameDecoder::decodeFrames(const std::vector<byte>& data, bool final) {
+	size_t position = 0;
+	while (true) {
+		size_t start = position;
+		while (start + 1 < data.size() && (data[start] != 0xFF || data[start + 1] != SOI)) {
+			start += 1;
+		}
+		if (start + 1 >= data.size()) {
+			// A trailing 0xFF may be the first half of the next SOI
+			return (!final && start < data.size() && data[start] == 0xFF) ? start : data.size();
+		}
+
+		size_t scanStart = 0;
+		size_t end = 0;
+		const FrameScan scan = scanFrame(data, start, scanStart, end);
+		if (scan == FrameScan::Incomplete && !final) {
+			return start;
+		}
+		if (scan == FrameScan::Complete && decodeFrame(data, start, scanStart)) {
+			decodedCount += 1;
+		}
+		else {
+			if (scan != FrameScan::Complete) {
+				std::cout << "Error: Frame " << frameCount << ((scan == FrameScan::Incomplete) ? " is cut off\n" : " is malformed\n");
+			}
+			// The next frame parses its headers again instead of trusting the ones that just failed
+			headerKey.clear();
+			failedCount += 1;
+		}
+		frameCount += 1;
+		searchFrom = 0;
+		position = (scan == FrameScan::Incomplete) ? data.size() : end;
+	}
+}
+
+// Walks the marker segments of the frame at start up to SOS, collecting frameKey, then finds EOI in the scan data.
+// end is one past EOI for a complete frame and where to look for the next SOI for a malformed one.
+FrameDecoder::FrameScan FrameDecoder::scanFrame(const std::vector<byte>& data, size_t start, size_t& scanStart, size_t& end) {
+	frameKey.clear();
+	size_t position = start + 2;
+	while (true) {
+		if (position + 1 >= data.size()) {
+			return FrameScan::Incomplete;
+		}
+		const byte marker = data[position + 1];
+		if (data[position] != 0xFF || marker == SOI || marker == EOI || (marker >= RST0 && marker <= RST7)) {
+			end = position;
+			return FrameScan::Malformed;
+		}
+		if (marker == 0xFF) { // fill byte
+			position += 1;
+			continue;
+		}
+		if (position + 3 >= data.size()) {
+			return FrameScan::Incomplete;
+		}
+		const size_t length = ((size_t)data[position + 2] << 8) | data[position + 3];
+		if (length < 2) {
+			end = position + 2;
+			return FrameScan::Malformed;
+		}
+		const size_t segmentEnd = position + 2 + length;
+		if (segmentEnd > data.size()) {
+			return FrameScan::Incomplete;
+		}
+		// APPn and COM segments often carry per frame timestamps and don't affect decoding
+		if ((marker < APP0 || marker > APP15) && marker != COM) {
+			frameKey.insert(frameKey.end(), data.begin() + position + 1, data.begin() + segmentEnd);
+		}
+		position = segmentEnd;
+		if (marker == SOS) {
+			break;
+		}
+	}
+	scanStart = position;
+
+	// Within scan data 0xFF is only followed by a stuffed zero, a restart marker, fill bytes or EOI
+	std::vector<byte>::const_iterator current = data.begin() + std::max(scanStart, start + searchFrom);
+	while ((current = std::find(current, data.end(), (byte)0xFF)) != data.end() && current + 1 != data.end()) {
+		const byte next = *(current + 1);
+		if (next == EOI) {
+			end = (size_t)(current - data.begin()) + 2;
+			return FrameScan::Complete;
+		}
+		if (next != 0x00 && next != 0xFF && (next < RST0 || next > RST7)) {
+			// Most likely the SOI of the next frame after a cut off one
+			end = (size_t)(current - data.begin());
+			return FrameScan::Malformed;
+		}
+		++current;
+	}
+	// The last byte is searched again, it may be the 0xFF of EOI
+	searchFrom = data.size() - 1 - start;
+	return FrameScan::Incomplete;
+}
+
+bool FrameDecoder::decodeFrame(const std::vector<byte>& data, size_t start, size_t scanStart) {
+	ByteReader reader(data);
+	const bool reused = jpeg != nullptr && frameKey == headerKey;
+	if (reused) {
+		jpeg->huffmanData.clear();
+		reader.seek(scanStart);
+	}
+	else {
+		headerKey.clear();
+		jpeg.reset(new (std::nothrow) JPEGImage);
+		if (jpeg == nullptr) {
+			std::cout << "Error: jpeg is null pointer\n";
+			return false;
+		}
+		reader.seek(start);
+		parseHeaders(reader, jpeg.get());
+		if (!jpeg->isValid) {
+			return false;
+		}
+		generateAllHuffmanCodes(jpeg.get());
+		headerKey = frameKey;
+	}
+	parseScanData(reader, jpeg.get());
+	if (!jpeg->isValid) {
+		return false;
+	}
+
+	const uint mcuColumns = (jpeg->width + 7) / 8;
+	const uint mcuRows = (jpeg->height + 7) / 8;
+	mcus.resize((size_t)mcuRows * mcuColumns);
+	MCU* const frameMCUs = mcus.data();
+	BitReader bitReader(jpeg->huffmanData);
+	int prevDCCoefficients[3] = { 0 };
+	if (!decodeMCURange(bitReader, jpeg.get(), prevDCCoefficients, frameMCUs, 0, mcuRows * mcuColumns, true)) {
+		return false;
+	}
+	const JPEGImage* const header = jpeg.get();
+	pool.parallelFor(mcuRows, [header, frameMCUs, mcuColumns](uint first, uint last) {
+		reconstructMCUs(header, frameMCUs + (size_t)first * mcuColumns, (last - first) * mcuColumns, 8);
+	});
+	reusedCount += reused ? 1 : 0;
+	onFrame(frameCount, header, frameMCUs);
+	return true;
+}
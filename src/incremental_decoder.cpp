@@ -0,0 +1,230 @@
+#include "../include/incremental_decoder.h"
+#include "../include/byte_reader.h"
+#include <iostream>
+#include <algorithm>
+
+void parseHeaders(ByteReader&, JPEGImage* const);
+void generateAllHuffmanCodes(JPEGImage* const);
+bool decodeMCURange(BitReader&, const JPEGImage* const, int* const, MCU* const, uint, uint, const bool);
+void reconstructMCUs(const JPEGImage* const, MCU* const, uint, const uint);
+
+// Longest possible Huffman coded block: a 16 bit DC code with 11 magnitude bits and 63 AC coefficients of 16 + 10 bits
+const size_t maxBlockBytes = (16 + 11 + 63 * (16 + 10) + 7) / 8;
+// Least amount of new scan data worth another attempt at a row that ran past the end
+const size_t minRetryBytes = 256;
+// Decoded scan data is dropped once this much of it has piled up in front of the bit reader
+const size_t discardThreshold = 64 * 1024;
+const byte TEM = 0x01;
+
+IncrementalDecoder::IncrementalDecoder(const HeaderCallback& onHeader, const RowCallback& onRow) :
+	onHeader(onHeader), onRow(onRow), jpeg(nullptr), prevDCCoefficients{ 0, 0, 0 }, nextRow(0), mcuRows(0), mcuColumns(0),
+	markerPending(false), scanComplete(false), hasFailed(false), retrySize(0) {}
+
+IncrementalDecoder::~IncrementalDecoder() {
+	bitReader.reset();
+	delete jpeg;
+}
+
+bool IncrementalDecoder::failed() const {
+	return hasFailed;
+}
+
+uint IncrementalDecoder::rowsDecoded() const {
+	return nextRow;
+}
+
+bool IncrementalDecoder::push(const byte* const data, size_t length) {
+	if (hasFailed) {
+		return false;
+	}
+	// Anything after EOI is not part of the image
+	if (scanComplete) {
+		return true;
+	}
+	if (jpeg == nullptr) {
+		header.insert(header.end(), data, data + length);
+		return parseHeader() && decodeRows();
+	}
+	return unstuff(data, length) && decodeRows();
+}
+
+bool IncrementalDecoder::finish() {
+	if (hasFailed) {
+		return false;
+	}
+	if (jpeg == nullptr) {
+		return fail("Error: Invalid end of JPEG\n");
+	}
+	// Rows up to the end of the data were already emitted by push, and after EOI every row was
+	if (!scanComplete || nextRow < mcuRows) {
+		return fail("Error: Bit-Stream prematurely ended\n");
+	}
+	return true;
+}
+
+// Offset just past the SOS segment once the header bytes received so far contain it, 0 while more are needed.
+// Malformed marker sequences end the header early so parseHeaders reports them.
+size_t IncrementalDecoder::headerEnd() const {
+	if (header.size() < 2) {
+		return 0;
+	}
+	if (header[0] != 0xFF || header[1] != SOI) {
+		return 2;
+	}
+	size_t position = 2;
+	while (true) {
+		if (position + 2 > header.size()) {
+			return 0;
+		}
+		if (header[position] != 0xFF) {
+			return position + 2;
+		}
+		const byte marker = header[position + 1];
+		if (marker == 0xFF) { // fill byte
+			position += 1;
+			continue;
+		}
+		if (marker == SOI || marker == EOI || marker == TEM || (marker >= RST0 && marker <= RST7)) {
+			return position + 2;
+		}
+		if (position + 4 > header.size()) {
+			return 0;
+		}
+		const size_t length = (header[position + 2] << 8) | header[position + 3];
+		if (length < 2) {
+			return position + 4;
+		}
+		if (position + 2 + length > header.size()) {
+			return 0;
+		}
+		position += 2 + length;
+		if (marker == SOS) {
+			return position;
+		}
+	}
+}
+
+bool IncrementalDecoder::parseHeader() {
+	const size_t end = headerEnd();
+	if (end == 0) {
+		return true;
+	}
+	const std::vector<byte> segments(header.begin(), header.begin() + end);
+	ByteReader reader(segments);
+	jpeg = new (std::nothrow) JPEGImage;
+	if (jpeg == nullptr) {
+		return fail("Error: jpeg is null pointer\n");
+	}
+	parseHeaders(reader, jpeg);
+	if (!jpeg->isValid) {
+		hasFailed = true;
+		return false;
+	}
+	if (jpeg->width == 0 || jpeg->height == 0) {
+		return fail("Error: Missing frame header\n");
+	}
+	mcuRows = (jpeg->height + 7) / 8;
+	mcuColumns = (jpeg->width + 7) / 8;
+	row.resize(mcuColumns);
+	generateAllHuffmanCodes(jpeg);
+	bitReader.reset(new BitReader(jpeg->huffmanData));
+	if (!onHeader(jpeg)) {
+		hasFailed = true;
+		return false;
+	}
+
+	// The rest of what arrived is the start of the scan
+	const std::vector<byte> scanStart(header.begin() + end, header.end());
+	std::vector<byte>().swap(header);
+	return unstuff(scanStart.data(), scanStart.size());
+}
+
+// Appends scan bytes to the entropy coded data the same way parseScanData does: stuffed zero bytes and
+// restart markers are removed, EOI ends the scan
+bool IncrementalDecoder::unstuff(const byte* const data, size_t length) {
+	std::vector<byte>& huffmanData = jpeg->huffmanData;
+	for (size_t i = 0; i < length; ++i) {
+		const byte current = data[i];
+		if (!markerPending) {
+			if (current == 0xFF) {
+				markerPending = true;
+			}
+			else {
+				huffmanData.push_back(current);
+			}
+			continue;
+		}
+		if (current == 0x00) {
+			huffmanData.push_back(0xFF);
+			markerPending = false;
+		}
+		else if (current == EOI) {
+			scanComplete = true;
+			return true;
+		}
+		else if (current >= RST0 && current <= RST7) {
+			markerPending = false;
+		}
+		else if (current != 0xFF) {
+			return fail("Error: Unexpected marker in scan data\n");
+		}
+	}
+	return true;
+}
+
+// Decodes, reconstructs and emits MCU rows until the next one runs past the data received so far.
+// A row that runs out of data is rolled back to its saved bit position and DC predictors and retried after more arrives.
+bool IncrementalDecoder::decodeRows() {
+	if (jpeg == nullptr) {
+		return true;
+	}
+	const std::vector<byte>& huffmanData = jpeg->huffmanData;
+	// Upper bound on the bytes of one row, restart alignment included
+	const size_t maxRowBytes = (size_t)mcuColumns * (jpeg->numComponents * maxBlockBytes + 1);
+	while (nextRow < mcuRows) {
+		if (!scanComplete && huffmanData.size() < retrySize) {
+			return true;
+		}
+		const size_t start = bitReader->position();
+		const size_t received = huffmanData.size() - start / 8;
+		const int savedDCCoefficients[3] = { prevDCCoefficients[0], prevDCCoefficients[1], prevDCCoefficients[2] };
+		// With the whole scan or more than any row can take available, a failed row is corrupt rather than incomplete
+		const bool final = scanComplete || received >= maxRowBytes;
+		if (!decodeMCURange(*bitReader, jpeg, prevDCCoefficients, row.data(), nextRow * mcuColumns, mcuColumns, final)) {
+			if (final) {
+				hasFailed = true;
+				return false;
+			}
+			bitReader->seek(start);
+			std::copy(savedDCCoefficients, savedDCCoefficients + 3, prevDCCoefficients);
+			// Growing the wait with the row keeps the repeated attempts at a large row to a constant factor of one decode
+			retrySize = huffmanData.size() + std::max(minRetryBytes, received / 4);
+			return true;
+		}
+		reconstructMCUs(jpeg, row.data(), mcuColumns, 8);
+		onRow(nextRow, row.data());
+		nextRow += 1;
+		// Neighbouring rows code to similar sizes, most of the last one has to arrive before the next is worth trying
+		const size_t rowBytes = (bitReader->position() - start) / 8;
+		retrySize = bitReader->position() / 8 + rowBytes * 3 / 4;
+		discardDecodedData();
+	}
+	return true;
+}
+
+void IncrementalDecoder::discardDecodedData() {
+	const size_t position = bitReader->position();
+	const size_t consumed = position / 8;
+	if (consumed < discardThreshold) {
+		return;
+	}
+	jpeg->huffmanData.erase(jpeg->huffmanData.begin(), jpeg->huffmanData.begin() + consumed);
+	bitReader->seek(position - consumed * 8);
+	retrySize -= consumed;
+}
+
+bool IncrementalDecoder::fail(const std::string& message) {
+	std::cout << message;
+	hasFailed = true;
+	return false;
+}
@@ -3,15 +3,144 @@
 #include <iostream>
 #include <cmath>
 #include "../include/bit_reader.h"
+#include "../include/thread_pool.h"
+#include "../include/bitmap_encoder.h"
+#include "../include/huffman_cache.h"
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <algorithm>
 
 byte getNextSymbol(BitReader&, const HuffmanTable&);
-bool decodeMCUComponent(BitReader&, int* const, int&, const HuffmanTable&, const HuffmanTable&);
+// StoreAC false only keeps the DC coefficient, the AC magnitude bits are skipped
+template <bool StoreAC = true>
+bool decodeMCUComponent(BitReader&, int* const, int&, const HuffmanTable&, const HuffmanTable&, const bool reportErrors = true);
 void generateHuffmanCodes(HuffmanTable&);
 void dequantizeComponent(const QuantizationTable&, int* const);
 void inverseDCTComp(int* const);
+void inverseDCTReduced(int* const, const uint);
 void clampBetween(int&, const int&, const int&);
 void convertMCU_ToRGB(MCU&);
 
+void attachHuffmanLookup(HuffmanTable& table) {
+	if (!table.set || table.lookup != nullptr) {
+		return;
+	}
+	table.lookup = acquireHuffmanLookup(table);
+	std::copy(table.lookup->codes, table.lookup->codes + 162, table.codes);
+}
+
+// Pulls the decode structures for every defined table from the process wide cache
+void generateAllHuffmanCodes(JPEGImage* const jpeg) {
+	for (uint i = 0; i < 4; ++i) {
+		attachHuffmanLookup(jpeg->huffmanDCTables[i]);
+		attachHuffmanLookup(jpeg->huffmanACTables[i]);
+	}
+}
+
+// Table pointers resolved once per image, so the kernels below don't go through colorComponents in their inner loops
+struct ComponentTables {
+	const HuffmanTable* dcTables[3] = { nullptr };
+	const HuffmanTable* acTables[3] = { nullptr };
+	const QuantizationTable* quantizationTables[3] = { nullptr };
+};
+
+ComponentTables resolveComponentTables(const JPEGImage* const jpeg) {
+	ComponentTables tables;
+	for (uint j = 0; j < jpeg->numComponents; ++j) {
+		tables.dcTables[j] = &jpeg->huffmanDCTables[jpeg->colorComponents[j].huffmanDCTableID];
+		tables.acTables[j] = &jpeg->huffmanACTables[jpeg->colorComponents[j].huffmanACTableID];
+		tables.quantizationTables[j] = &jpeg->quantizationTables[jpeg->colorComponents[j].quantizationTableID];
+	}
+	return tables;
+}
+
+// Chroma access for the kernels, GrayMCU only has a Y plane and never takes the 3 component branches
+int* chromaBlue(MCU& mcu) {
+	return mcu.cb;
+}
+
+int* chromaBlue(GrayMCU&) {
+	return nullptr;
+}
+
+int* chromaRed(MCU& mcu) {
+	return mcu.cr;
+}
+
+int* chromaRed(GrayMCU&) {
+	return nullptr;
+}
+
+// The one walk over the MCUs of a scan every entropy decoder shares: restart intervals, DC prediction and the
+// block of each component. destination(k, j) is where component j of the k-th MCU from firstMCU goes.
+// Specialized on the component count and on whether restart intervals are in use,
+// so the per-MCU component loop is unrolled and the restart check disappears when unused.
+template <uint NumComponents, bool Restart, bool StoreAC, typename Destination>
+bool decodeScanBlocks(BitReader& bitReader, const ComponentTables& tables, const uint restartInterval, int* const prevDCCoefficients,
+	uint firstMCU, uint count, const Destination& destination, const bool reportErrors) {
+	for (uint k = 0; k < count; ++k) {
+		const uint i = firstMCU + k;
+		if (Restart && i % restartInterval == 0) {
+			prevDCCoefficients[0] = 0;
+			prevDCCoefficients[1] = 0;
+			prevDCCoefficients[2] = 0;
+			bitReader.align();
+		}
+		// decodeMCUComponent processes a single channel of a single MCU
+		for (uint j = 0; j < NumComponents; ++j) {
+			if (!decodeMCUComponent<StoreAC>(bitReader, destination(k, j), prevDCCoefficients[j], *tables.dcTables[j], *tables.acTables[j], reportErrors)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// decodeScanBlocks for the component count and restart interval of jpeg, for decoders that aren't specialized themselves
+template <bool StoreAC, typename Destination>
+bool decodeScanBlocks(BitReader& bitReader, const JPEGImage* const jpeg, int* const prevDCCoefficients, uint firstMCU, uint count,
+	const Destination& destination, const bool reportErrors) {
+	const ComponentTables tables = resolveComponentTables(jpeg);
+	const uint restartInterval = jpeg->restartInterval;
+	if (jpeg->numComponents == 1) {
+		return (restartInterval != 0) ?
+			decodeScanBlocks<1, true, StoreAC>(bitReader, tables, restartInterval, prevDCCoefficients, firstMCU, count, destination, reportErrors) :
+			decodeScanBlocks<1, false, StoreAC>(bitReader, tables, restartInterval, prevDCCoefficients, firstMCU, count, destination, reportErrors);
+	}
+	return (restartInterval != 0) ?
+		decodeScanBlocks<3, true, StoreAC>(bitReader, tables, restartInterval, prevDCCoefficients, firstMCU, count, destination, reportErrors) :
+		decodeScanBlocks<3, false, StoreAC>(bitReader, tables, restartInterval, prevDCCoefficients, firstMCU, count, destination, reportErrors);
+}
+
+// Decodes count MCUs starting at absolute index firstMCU into mcus[0..count)
+template <uint NumComponents, bool Restart, typename Block = MCU>
+bool decodeMCURangeKernel(BitReader& bitReader, const JPEGImage* const jpeg, int* const prevDCCoefficients, Block* const mcus, uint firstMCU, uint count,
+	const bool reportErrors = true) {
+	const auto destination = [mcus](uint k, uint j) {
+		return (j == 0) ? mcus[k].y : (j == 1) ? chromaBlue(mcus[k]) : chromaRed(mcus[k]);
+	};
+	return decodeScanBlocks<NumComponents, Restart, true>(bitReader, resolveComponentTables(jpeg), jpeg->restartInterval, prevDCCoefficients,
+		firstMCU, count, destination, reportErrors);
+}
+
+typedef bool (*DecodeMCURangeKernel)(BitReader&, const JPEGImage* const, int* const, MCU* const, uint, uint, const bool);
+
+DecodeMCURangeKernel selectDecodeKernel(const JPEGImage* const jpeg) {
+	const bool restart = jpeg->restartInterval != 0;
+	if (jpeg->numComponents == 1) {
+		return restart ? decodeMCURangeKernel<1, true> : decodeMCURangeKernel<1, false>;
+	}
+	return restart ? decodeMCURangeKernel<3, true> : decodeMCURangeKernel<3, false>;
+}
+
+// Entropy decodes count MCUs starting at absolute index firstMCU, for decoders that keep the bit reader and DC predictors
+// between calls themselves. The Huffman tables must already be attached with generateAllHuffmanCodes.
+bool decodeMCURange(BitReader& bitReader, const JPEGImage* const jpeg, int* const prevDCCoefficients, MCU* const mcus, uint firstMCU, uint count,
+	const bool reportErrors) {
+	return selectDecodeKernel(jpeg)(bitReader, jpeg, prevDCCoefficients, mcus, firstMCU, count, reportErrors);
+}
+
 MCU* decodeHuffmanData(JPEGImage* const jpeg) {
 	const uint mcuRows = (jpeg->height + 7) / 8;
 	const uint mcuColumns = (jpeg->width + 7) / 8;
@@ -23,53 +152,283 @@ MCU* decodeHuffmanData(JPEGImage* const jpeg) {
 		return nullptr;
 	}
 
+	generateAllHuffmanCodes(jpeg);
+	
+	BitReader bitReader(jpeg->huffmanData);
+	if (!selectDecodeKernel(jpeg)(bitReader, jpeg, prevDCCoefficients, mcus, 0, mcuRows * mcuColumns, true)) {
+		delete[] mcus;
+		return nullptr;
+	}
+	return mcus;
+}
+
+// Grayscale fast path: only the Y plane is allocated and decoded, 64 ints per block instead of 192
+GrayMCU* decodeGrayscaleData(JPEGImage* const jpeg) {
+	const uint mcuRows = (jpeg->height + 7) / 8;
+	const uint mcuColumns = (jpeg->width + 7) / 8;
+	int prevDCCoefficients[3] = { 0 };
+	GrayMCU* blocks = new (std::nothrow) GrayMCU[mcuRows * mcuColumns];
+	if (blocks == nullptr) {
+		std::cout << "Error: Decoder error, grayscale blocks are null\n";
+		return nullptr;
+	}
+
+	generateAllHuffmanCodes(jpeg);
+
+	BitReader bitReader(jpeg->huffmanData);
+	const bool decoded = (jpeg->restartInterval != 0) ?
+		decodeMCURangeKernel<1, true>(bitReader, jpeg, prevDCCoefficients, blocks, 0, mcuRows * mcuColumns) :
+		decodeMCURangeKernel<1, false>(bitReader, jpeg, prevDCCoefficients, blocks, 0, mcuRows * mcuColumns);
+	if (!decoded) {
+		delete[] blocks;
+		return nullptr;
+	}
+	return blocks;
+}
+
+// Entropy decodes straight into per-component coefficient planes, skipping dequantization, IDCT and color conversion.
+// The copied quantization tables use the same coefficient order as the planes.
+CoefficientImage* decodeCoefficients(JPEGImage* const jpeg, const bool zigZagOrder) {
+	const uint mcuRows = (jpeg->height + 7) / 8;
+	const uint mcuColumns = (jpeg->width + 7) / 8;
+	CoefficientImage* image = new (std::nothrow) CoefficientImage;
+	if (image == nullptr) {
+		std::cout << "Error: Decoder error, coefficient image is null\n";
+		return nullptr;
+	}
+	image->height = jpeg->height;
+	image->width = jpeg->width;
+	image->numComponents = jpeg->numComponents;
+	image->zigZagOrder = zigZagOrder;
 	for (uint i = 0; i < 4; ++i) {
-		if (jpeg->huffmanDCTables[i].set) {
-			generateHuffmanCodes(jpeg->huffmanDCTables[i]);
+		image->quantizationTables[i] = jpeg->quantizationTables[i];
+	}
+	for (uint j = 0; j < jpeg->numComponents; ++j) {
+		CoefficientPlane& plane = image->planes[j];
+		plane.blocksWide = mcuColumns;
+		plane.blocksHigh = mcuRows;
+		plane.quantizationTableID = jpeg->colorComponents[j].quantizationTableID;
+		plane.coefficients.assign((size_t)mcuRows * mcuColumns * 64, 0);
+	}
+
+	generateAllHuffmanCodes(jpeg);
+
+	BitReader bitReader(jpeg->huffmanData);
+	int prevDCCoefficients[3] = { 0 };
+	CoefficientPlane* const planes = image->planes;
+	const auto destination = [planes](uint k, uint j) { return &planes[j].coefficients[(size_t)k * 64]; };
+	if (!decodeScanBlocks<true>(bitReader, jpeg, prevDCCoefficients, 0, mcuRows * mcuColumns, destination, true)) {
+		delete image;
+		return nullptr;
+	}
+
+	if (zigZagOrder) {
+		int natural[64];
+		for (uint i = 0; i < 4; ++i) {
+			QuantizationTable& qt = image->quantizationTables[i];
+			std::copy(qt.table, qt.table + 64, natural);
+			for (uint k = 0; k < 64; ++k) {
+				qt.table[k] = natural[zigZagMap[k]];
+			}
+		}
+		for (uint j = 0; j < jpeg->numComponents; ++j) {
+			std::vector<int>& coefficients = image->planes[j].coefficients;
+			for (size_t b = 0; b < coefficients.size(); b += 64) {
+				std::copy(coefficients.begin() + b, coefficients.begin() + b + 64, natural);
+				for (uint k = 0; k < 64; ++k) {
+					coefficients[b + k] = natural[zigZagMap[k]];
+				}
+			}
 		}
+	}
+	return image;
+}
 
-		if (jpeg->huffmanACTables[i].set) {
-			generateHuffmanCodes(jpeg->huffmanACTables[i]);
+// DC-only decode: one dequantized DC coefficient per block and component, row major in planes[component].
+// The DC term is eight times the block's mean sample, so this is the image at 1/8 scale without any IDCT.
+bool decodeDCCoefficients(JPEGImage* const jpeg, std::vector<int>* const planes) {
+	const uint blocks = ((jpeg->height + 7) / 8) * ((jpeg->width + 7) / 8);
+	generateAllHuffmanCodes(jpeg);
+	const ComponentTables tables = resolveComponentTables(jpeg);
+	for (uint j = 0; j < jpeg->numComponents; ++j) {
+		planes[j].assign(blocks, 0);
+	}
+
+	BitReader bitReader(jpeg->huffmanData);
+	int prevDCCoefficients[3] = { 0 };
+	// The AC symbols still have to be read to find where the next block starts, but only the DC term is stored
+	const auto destination = [planes](uint k, uint j) { return &planes[j][k]; };
+	if (!decodeScanBlocks<false>(bitReader, jpeg, prevDCCoefficients, 0, blocks, destination, true)) {
+		return false;
+	}
+	for (uint j = 0; j < jpeg->numComponents; ++j) {
+		const int quantization = (int)tables.quantizationTables[j]->table[0];
+		for (int& dc : planes[j]) {
+			dc *= quantization;
 		}
 	}
-	
+	return true;
+}
+
+// Speculative decoding of scans without restart markers:
+// The stream is cut into chunks at guessed bit positions and every chunk is decoded independently, relying on
+// JPEG Huffman codes to self-synchronize shortly after a wrong starting point. Chunks store DC differences instead of
+// absolute DC values and record the bit position each MCU started at, so they can be stitched together afterwards.
+struct SpeculativeChunk {
+	std::vector<MCU> mcus;
+	std::vector<size_t> startBits; // startBits[i] is where mcus[i] began, startBits.back() is where the chunk ended
+};
+
+const uint minSpeculativeChunkBytes = 16 * 1024;
+const uint maxSpeculativeRetries = 64;
+
+// Decodes a single MCU storing DC differences, returns false on an invalid code or the end of data
+bool decodeMCUDifferences(BitReader& bitReader, const JPEGImage* const jpeg, MCU& mcu, const bool reportErrors) {
+	for (uint j = 0; j < jpeg->numComponents; ++j) {
+		int noPrediction = 0;
+		if (!decodeMCUComponent(bitReader,
+			mcu[j],
+			noPrediction,
+			jpeg->huffmanDCTables[jpeg->colorComponents[j].huffmanDCTableID],
+			jpeg->huffmanACTables[jpeg->colorComponents[j].huffmanACTableID],
+			reportErrors)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void decodeSpeculativeChunk(const JPEGImage* const jpeg, size_t startBit, size_t endBit, uint maxMCUs, SpeculativeChunk& chunk) {
 	BitReader bitReader(jpeg->huffmanData);
-	for (uint i = 0; i < mcuRows * mcuColumns; ++i) {
-		if (jpeg->restartInterval != 0 && i % jpeg->restartInterval == 0) {
-			prevDCCoefficients[0] = 0;
-			prevDCCoefficients[1] = 0;
-			prevDCCoefficients[2] = 0;
-			bitReader.align();
+	for (uint attempt = 0; attempt < maxSpeculativeRetries && startBit < endBit; ++attempt, ++startBit) {
+		chunk.mcus.clear();
+		chunk.startBits.clear();
+		bitReader.seek(startBit);
+		bool synced = true;
+		while (bitReader.position() < endBit && chunk.mcus.size() < maxMCUs) {
+			chunk.startBits.push_back(bitReader.position());
+			chunk.mcus.emplace_back();
+			if (!decodeMCUDifferences(bitReader, jpeg, chunk.mcus.back(), false)) {
+				synced = false;
+				break;
+			}
 		}
-		for (uint j = 0; j < jpeg->numComponents; ++j) {
-			#pragma warning(push)
-			#pragma warning(disable: 6385)
-			if (!decodeMCUComponent(bitReader,
-				(mcus[i])[j],
-				prevDCCoefficients[j],
-				jpeg->huffmanDCTables[jpeg->colorComponents[j].huffmanDCTableID],
-				jpeg->huffmanACTables[jpeg->colorComponents[j].huffmanACTableID])) { // decodeMCUComponent processes a single channel of a single MCU
+		if (synced) {
+			chunk.startBits.push_back(bitReader.position());
+			return;
+		}
+		if (bitReader.position() >= bitReader.size()) {
+			// Ran into the end of the stream, only the last MCU is incomplete
+			chunk.mcus.pop_back();
+			return;
+		}
+		// An invalid code means this starting point was out of sync, slide forward one bit and try again
+	}
+	chunk.mcus.clear();
+	chunk.startBits.clear();
+}
+
+// Turns the DC differences left by decodeMCUDifferences back into absolute values
+template <uint NumComponents>
+void accumulateDCDifferences(MCU* const mcus, uint count) {
+	int prevDCCoefficients[3] = { 0 };
+	for (uint i = 0; i < count; ++i) {
+		for (uint j = 0; j < NumComponents; ++j) {
+			prevDCCoefficients[j] += mcus[i][j][0];
+			mcus[i][j][0] = prevDCCoefficients[j];
+		}
+	}
+}
+
+MCU* decodeHuffmanDataSpeculative(JPEGImage* const jpeg, ThreadPool& pool) {
+	const uint chunkCount = (uint)std::min<size_t>(pool.size(), jpeg->huffmanData.size() / minSpeculativeChunkBytes);
+	if (jpeg->restartInterval != 0 || chunkCount <= 1) {
+		return decodeHuffmanData(jpeg);
+	}
+	const uint mcuRows = (jpeg->height + 7) / 8;
+	const uint mcuColumns = (jpeg->width + 7) / 8;
+	const uint mcuCount = mcuRows * mcuColumns;
+	std::cout << "jpegHeight: " << jpeg->height << " jpegWidth: " << jpeg->width << " mcuRows: " << mcuRows << " mcuCols: " << mcuColumns << "\n";
+	MCU* mcus = new (std::nothrow) MCU[mcuCount];
+	if (mcus == nullptr) {
+		std::cout << "Error: Decoder error, mcus are null\n";
+		return nullptr;
+	}
+	generateAllHuffmanCodes(jpeg);
+
+	// Chunk 0 starts on a real MCU boundary, the others start on byte boundaries and resynchronize on their own
+	const size_t totalBits = jpeg->huffmanData.size() * 8;
+	std::vector<SpeculativeChunk> chunks(chunkCount);
+	pool.forEachIndex(chunkCount, [&](uint c) {
+		const size_t startBit = totalBits / chunkCount * c / 8 * 8;
+		const size_t endBit = (c + 1 == chunkCount) ? totalBits : totalBits / chunkCount * (c + 1) / 8 * 8;
+		decodeSpeculativeChunk(jpeg, startBit, endBit, mcuCount, chunks[c]);
+	});
+
+	// Stitch the chunks together: decode serially from the true end of the previous chunk until the true position
+	// matches an MCU start recorded by the next chunk, from there on its MCUs are known to be correct
+	BitReader bitReader(jpeg->huffmanData);
+	uint next = 0;
+	for (uint c = 0; c < chunkCount && next < mcuCount; ++c) {
+		const SpeculativeChunk& chunk = chunks[c];
+		while (next < mcuCount) {
+			const size_t position = bitReader.position();
+			const std::vector<size_t>::const_iterator match = std::lower_bound(chunk.startBits.begin(), chunk.startBits.end() - (chunk.startBits.empty() ? 0 : 1), position);
+			if (!chunk.mcus.empty() && match != chunk.startBits.end() - 1 && *match == position) {
+				const uint first = (uint)(match - chunk.startBits.begin());
+				const uint count = std::min<uint>((uint)chunk.mcus.size() - first, mcuCount - next);
+				std::copy(chunk.mcus.begin() + first, chunk.mcus.begin() + first + count, mcus + next);
+				next += count;
+				bitReader.seek(chunk.startBits[first + count]);
+				break;
+			}
+			if (chunk.startBits.empty() || position >= chunk.startBits.back()) {
+				break;
+			}
+			if (!decodeMCUDifferences(bitReader, jpeg, mcus[next], true)) {
 				delete[] mcus;
 				return nullptr;
 			}
+			next += 1;
+		}
+	}
+	for (; next < mcuCount; ++next) {
+		if (!decodeMCUDifferences(bitReader, jpeg, mcus[next], true)) {
+			delete[] mcus;
+			return nullptr;
 		}
 	}
+
+	if (jpeg->numComponents == 1) {
+		accumulateDCDifferences<1>(mcus, mcuCount);
+	}
+	else {
+		accumulateDCDifferences<3>(mcus, mcuCount);
+	}
 	return mcus;
 }
 
-bool decodeMCUComponent(BitReader& br, int* const component, int& prevDC, const HuffmanTable& dcTable, const HuffmanTable& acTable) {
+template <bool StoreAC>
+bool decodeMCUComponent(BitReader& br, int* const component, int& prevDC, const HuffmanTable& dcTable, const HuffmanTable& acTable, const bool reportErrors) {
 	// Get DC Value for this mcu component
 	byte length = getNextSymbol(br, dcTable);
 	if (length == (byte)-1) {
-		std::cout << "Error: Invalid DC Value\n";
+		if (reportErrors) {
+			std::cout << "Error: Invalid DC Value\n";
+		}
 		return false;
 	}
 	if (length > 11) {
-		std::cout << "Error: DC Coefficient can't be larger than 11\n";
+		if (reportErrors) {
+			std::cout << "Error: DC Coefficient can't be larger than 11\n";
+		}
+		return false;
 	}
 	int coefficient = br.readBits(length);
 	if (coefficient == -1) {
-		std::cout << "Error: invalid DC value\n";
+		if (reportErrors) {
+			std::cout << "Error: invalid DC value\n";
+		}
 		return false;
 	}
 	if (length != 0 && coefficient < (1 << (length - 1))) {
@@ -83,11 +442,13 @@ bool decodeMCUComponent(BitReader& br, int* const component, int& prevDC, const
 	while (i < 64) {
 		byte symbol = getNextSymbol(br, acTable);
 		if (symbol == (byte)-1) {
-			std::cout << "Error: Invalid AC value\n";
+			if (reportErrors) {
+				std::cout << "Error: Invalid AC value\n";
+			}
 			return false;
 		}
 		if (symbol == 0x00) {
-			for (; i < 64; ++i) {
+			for (; StoreAC && i < 64; ++i) {
 				component[zigZagMap[i]] = 0;
 			}
 			return true;
@@ -100,20 +461,37 @@ bool decodeMCUComponent(BitReader& br, int* const component, int& prevDC, const
 		}
 
 		if (i + zerosToSkip >= 64) {
-			std::cout << "Error: zeros length exceeds MCU length\n";
+			if (reportErrors) {
+				std::cout << "Error: zeros length exceeds MCU length\n";
+			}
 			return false;
 		}
-		for (uint j = 0; j < zerosToSkip; ++j, ++i) {
-			component[zigZagMap[i]] = 0;
+		for (uint j = 0; StoreAC && j < zerosToSkip; ++j) {
+			component[zigZagMap[i + j]] = 0;
 		}
+		i += zerosToSkip;
 		if (coefficientLength > 10) {
-			std::cout << "Error: AC coefficient length greater than 10 not allowed\n";
+			if (reportErrors) {
+				std::cout << "Error: AC coefficient length greater than 10 not allowed\n";
+			}
 			return false;
 		}
-		if (coefficientLength != 0) {
+		if (coefficientLength != 0 && !StoreAC) {
+			if (br.position() + coefficientLength > br.size()) {
+				if (reportErrors) {
+					std::cout << "Error: AC value invalid\n";
+				}
+				return false;
+			}
+			br.skipBits(coefficientLength);
+			i += 1;
+		}
+		else if (coefficientLength != 0) {
 			coefficient = br.readBits(coefficientLength);
 			if (coefficient == -1) {
-				std::cout << "Error: AC value invalid\n";
+				if (reportErrors) {
+					std::cout << "Error: AC value invalid\n";
+				}
 				return false;
 			}
 			if (coefficient < (1 << (coefficientLength - 1))) {
@@ -128,6 +506,18 @@ bool decodeMCUComponent(BitReader& br, int* const component, int& prevDC, const
 
 
 byte getNextSymbol(BitReader& br, const HuffmanTable& table) {
+	// Codes up to huffmanLookaheadBits long resolve with a single table lookup
+	if (table.lookup != nullptr) {
+		const uint window = br.peekBits(huffmanLookaheadBits);
+		const byte length = table.lookup->lookaheadLengths[window];
+		if (length != 0) {
+			if (br.position() + length > br.size()) {
+				return -1;
+			}
+			br.skipBits(length);
+			return table.lookup->lookaheadSymbols[window];
+		}
+	}
 	uint currentCode = 0;
 	for (uint i = 0; i < 16; ++i) {
 		int bit = br.readNextBit();
@@ -155,16 +545,40 @@ void generateHuffmanCodes(HuffmanTable& table) {
 	}
 }
 
-void dequantize(const JPEGImage* const jpeg, MCU* const mcus) {
+// Runs rowTask over the MCU rows of the image, split across the pool when one is given
+void forEachMCURow(const JPEGImage* const jpeg, ThreadPool* const pool, const std::function<void(uint, uint)>& rowTask) {
 	const uint mcuRows = (jpeg->height + 7) / 8;
-	const uint mcuCols = (jpeg->width + 7) / 8;
-	for (uint i = 0; i < mcuRows * mcuCols; ++i) {
-		for (uint j = 0; j < jpeg->numComponents; ++j) {
-			dequantizeComponent(jpeg->quantizationTables[jpeg->colorComponents[j].quantizationTableID], (mcus[i])[j]);
+	if (pool == nullptr) {
+		rowTask(0, mcuRows);
+		return;
+	}
+	pool->parallelFor(mcuRows, rowTask);
+}
+
+template <uint NumComponents>
+void dequantizeMCUs(const ComponentTables& tables, MCU* const mcus, uint first, uint last) {
+	for (uint i = first; i < last; ++i) {
+		dequantizeComponent(*tables.quantizationTables[0], mcus[i].y);
+		if (NumComponents == 3) {
+			dequantizeComponent(*tables.quantizationTables[1], mcus[i].cb);
+			dequantizeComponent(*tables.quantizationTables[2], mcus[i].cr);
 		}
 	}
 }
 
+void dequantize(const JPEGImage* const jpeg, MCU* const mcus, ThreadPool* const pool) {
+	const uint mcuCols = (jpeg->width + 7) / 8;
+	const ComponentTables tables = resolveComponentTables(jpeg);
+	forEachMCURow(jpeg, pool, [jpeg, mcus, mcuCols, &tables](uint firstRow, uint lastRow) {
+		if (jpeg->numComponents == 1) {
+			dequantizeMCUs<1>(tables, mcus, firstRow * mcuCols, lastRow * mcuCols);
+		}
+		else {
+			dequantizeMCUs<3>(tables, mcus, firstRow * mcuCols, lastRow * mcuCols);
+		}
+	});
+}
+
 void dequantizeComponent(const QuantizationTable& qt, int* const component) {
 	for (uint i = 0; i < 64; ++i) {
 		component[i] *= qt.table[i];
@@ -172,14 +586,87 @@ void dequantizeComponent(const QuantizationTable& qt, int* const component) {
 }
 
 
-void inverseDCT(const JPEGImage* const jpeg, MCU* const mcus) {
-
+template <uint NumComponents>
+void inverseDCTMCUs(MCU* const mcus, uint first, uint last, const uint blockSize) {
+	if (blockSize != 8) {
+		for (uint i = first; i < last; ++i) {
+			inverseDCTReduced(mcus[i].y, blockSize);
+			if (NumComponents == 3) {
+				inverseDCTReduced(mcus[i].cb, blockSize);
+				inverseDCTReduced(mcus[i].cr, blockSize);
+			}
+		}
+		return;
+	}
+	for (uint i = first; i < last; ++i) {
+		inverseDCTComp(mcus[i].y);
+		if (NumComponents == 3) {
+			inverseDCTComp(mcus[i].cb);
+			inverseDCTComp(mcus[i].cr);
+		}
+	}
+}
 
-	const uint mcuRows = (jpeg->height + 7) / 8;
+// blockSize below 8 runs the scaled IDCT, leaving a blockSize x blockSize image in the top left of every block
+void inverseDCT(const JPEGImage* const jpeg, MCU* const mcus, ThreadPool* const pool, const uint blockSize) {
 	const uint mcuCols = (jpeg->width + 7) / 8;
-	for (uint i = 0; i < mcuRows * mcuCols; ++i) {
-		for (uint j = 0; j < jpeg->numComponents; ++j) {
-			inverseDCTComp((mcus[i])[j]);
+	forEachMCURow(jpeg, pool, [jpeg, mcus, mcuCols, blockSize](uint firstRow, uint lastRow) {
+		if (jpeg->numComponents == 1) {
+			inverseDCTMCUs<1>(mcus, firstRow * mcuCols, lastRow * mcuCols, blockSize);
+		}
+		else {
+			inverseDCTMCUs<3>(mcus, firstRow * mcuCols, lastRow * mcuCols, blockSize);
+		}
+	});
+}
+
+// N point IDCT basis for the scaled IDCT, C(u) / 2 * cos((2x + 1)u * pi / 2N) keeps the 8 point normalization,
+// so the low frequency N x N coefficients reconstruct the block decimated by 8 / N
+struct ReducedIDCTBasis {
+	float values[4][4];
+
+	ReducedIDCTBasis(uint size) {
+		for (uint x = 0; x < size; ++x) {
+			for (uint u = 0; u < size; ++u) {
+				const double scale = (u == 0) ? 1.0 / (2.0 * std::sqrt(2.0)) : 0.5;
+				values[x][u] = (float)(scale * std::cos((2.0 * x + 1.0) * u * U_PI / (2.0 * size)));
+			}
+		}
+	}
+};
+
+// Rounds half away from zero, truncating after adding 0.5 would pull every negative sample up by one
+inline int roundSample(const float value) {
+	return (int)(value + ((value < 0.0f) ? -0.5f : 0.5f));
+}
+
+const ReducedIDCTBasis reducedIDCTBasis4(4);
+const ReducedIDCTBasis reducedIDCTBasis2(2);
+
+void inverseDCTReduced(int* const component, const uint size) {
+	if (size == 1) {
+		// 1/8 scale keeps only the DC term, the block mean
+		component[0] = roundSample(component[0] / 8.0f);
+		return;
+	}
+	const float (*basis)[4] = (size == 4) ? reducedIDCTBasis4.values : reducedIDCTBasis2.values;
+	float temp[4 * 4];
+	for (uint v = 0; v < size; ++v) {
+		for (uint x = 0; x < size; ++x) {
+			float sum = 0.0f;
+			for (uint u = 0; u < size; ++u) {
+				sum += basis[x][u] * component[v * 8 + u];
+			}
+			temp[v * 4 + x] = sum;
+		}
+	}
+	for (uint y = 0; y < size; ++y) {
+		for (uint x = 0; x < size; ++x) {
+			float sum = 0.0f;
+			for (uint v = 0; v < size; ++v) {
+				sum += basis[y][v] * temp[v * 4 + x];
+			}
+			component[y * 8 + x] = roundSample(sum);
 		}
 	}
 }
@@ -314,30 +801,80 @@ void inverseDCTComp(int* const component) {
 		const float b6 = c6 - c7;
 		const float b7 = c7;
 
-		component[i * 8 + 0] = b0 + b7 + 0.5f;
-		component[i * 8 + 1] = b1 + b6 + 0.5f;
-		component[i * 8 + 2] = b2 + b5 + 0.5f;
-		component[i * 8 + 3] = b3 + b4 + 0.5f;
-		component[i * 8 + 4] = b3 - b4 + 0.5f;
-		component[i * 8 + 5] = b2 - b5 + 0.5f;
-		component[i * 8 + 6] = b1 - b6 + 0.5f;
-		component[i * 8 + 7] = b0 - b7 + 0.5f;
+		component[i * 8 + 0] = roundSample(b0 + b7);
+		component[i * 8 + 1] = roundSample(b1 + b6);
+		component[i * 8 + 2] = roundSample(b2 + b5);
+		component[i * 8 + 3] = roundSample(b3 + b4);
+		component[i * 8 + 4] = roundSample(b3 - b4);
+		component[i * 8 + 5] = roundSample(b2 - b5);
+		component[i * 8 + 6] = roundSample(b1 - b6);
+		component[i * 8 + 7] = roundSample(b0 - b7);
 	}
 }
 
-void convertToRGB(const JPEGImage* jpeg, MCU* const mcus) {
-	const uint mcuRows = (jpeg->height + 7) / 8;
-	const uint mcuCols = (jpeg->width + 7) / 8;
-	for (uint i = 0; i < mcuRows * mcuCols; ++i) {
-		convertMCU_ToRGB(mcus[i]);
+// With a single component Cb and Cr are zero, so R, G and B all equal the level shifted Y
+void convertGrayscaleMCU_ToRGB(MCU& mcu) {
+	for (uint i = 0; i < 64; ++i) {
+		int y = mcu.y[i] + 128;
+		clampBetween(y, 0, 255);
+		mcu.r[i] = y;
+		mcu.g[i] = y;
+		mcu.b[i] = y;
 	}
 }
 
+template <uint NumComponents>
+void convertMCUs_ToRGB(MCU* const mcus, uint first, uint last) {
+	for (uint i = first; i < last; ++i) {
+		if (NumComponents == 1) {
+			convertGrayscaleMCU_ToRGB(mcus[i]);
+		}
+		else {
+			convertMCU_ToRGB(mcus[i]);
+		}
+	}
+}
+
+// Dequantize, IDCT and level shift the Y plane in one pass per block, leaving 0-255 sample values in place
+void reconstructGrayscale(const JPEGImage* const jpeg, GrayMCU* const blocks, ThreadPool* const pool, const uint blockSize) {
+	const uint mcuCols = (jpeg->width + 7) / 8;
+	const QuantizationTable& qt = jpeg->quantizationTables[jpeg->colorComponents[0].quantizationTableID];
+	forEachMCURow(jpeg, pool, [blocks, mcuCols, &qt, blockSize](uint firstRow, uint lastRow) {
+		for (uint i = firstRow * mcuCols; i < lastRow * mcuCols; ++i) {
+			int* const y = blocks[i].y;
+			dequantizeComponent(qt, y);
+			if (blockSize == 8) {
+				inverseDCTComp(y);
+			}
+			else {
+				inverseDCTReduced(y, blockSize);
+			}
+			for (uint k = 0; k < 64; ++k) {
+				y[k] += 128;
+				clampBetween(y[k], 0, 255);
+			}
+		}
+	});
+}
+
+void convertToRGB(const JPEGImage* jpeg, MCU* const mcus, ThreadPool* const pool) {
+	const uint mcuCols = (jpeg->width + 7) / 8;
+	forEachMCURow(jpeg, pool, [jpeg, mcus, mcuCols](uint firstRow, uint lastRow) {
+		if (jpeg->numComponents == 1) {
+			convertMCUs_ToRGB<1>(mcus, firstRow * mcuCols, lastRow * mcuCols);
+		}
+		else {
+			convertMCUs_ToRGB<3>(mcus, firstRow * mcuCols, lastRow * mcuCols);
+		}
+	});
+}
+
 void convertMCU_ToRGB(MCU& mcu) {
 	for (uint i = 0; i < 64; ++i) {
-		int r = mcu.y[i] + 1.402f * mcu.cr[i] + 128;
-		int g = mcu.y[i] + 0.344f * mcu.cb[i] - 0.714f * mcu.cr[i] + 128;
-		int b = mcu.y[i] + 1.772f * mcu.cb[i] + 128;
+		// 128.5 level shifts and rounds, anything that would round below zero is clamped anyway
+		int r = mcu.y[i] + 1.402f * mcu.cr[i] + 128.5f;
+		int g = mcu.y[i] - 0.344136f * mcu.cb[i] - 0.714136f * mcu.cr[i] + 128.5f;
+		int b = mcu.y[i] + 1.772f * mcu.cb[i] + 128.5f;
 		clampBetween(r, 0, 255);
 		clampBetween(g, 0, 255);
 		clampBetween(b, 0, 255);
@@ -354,4 +891,107 @@ void clampBetween(int& n, const int& start, const int& end) {
 	else if (n > end) {
 		n = end;
 	}
+}
+
+template <uint NumComponents>
+void processMCUs(const ComponentTables& tables, MCU* const mcus, uint count, const uint blockSize) {
+	dequantizeMCUs<NumComponents>(tables, mcus, 0, count);
+	inverseDCTMCUs<NumComponents>(mcus, 0, count, blockSize);
+	convertMCUs_ToRGB<NumComponents>(mcus, 0, count);
+}
+
+// Dequantization, IDCT and color conversion of count entropy decoded MCUs on the calling thread
+void reconstructMCUs(const JPEGImage* const jpeg, MCU* const mcus, uint count, const uint blockSize) {
+	const ComponentTables tables = resolveComponentTables(jpeg);
+	if (jpeg->numComponents == 1) {
+		processMCUs<1>(tables, mcus, count, blockSize);
+	}
+	else {
+		processMCUs<3>(tables, mcus, count, blockSize);
+	}
+}
+
+// Producer/consumer decode: an entropy thread Huffman-decodes MCU rows into a ring of ringRows row slots,
+// the pool runs the pixel stages on each decoded row, and the calling thread hands finished rows to writeRow in order
+bool decodePipelined(JPEGImage* const jpeg, ThreadPool& pool, uint ringRows, const uint blockSize, const std::function<void(uint, const MCU*)>& writeRow) {
+	const uint mcuRows = (jpeg->height + 7) / 8;
+	const uint mcuColumns = (jpeg->width + 7) / 8;
+	if (ringRows == 0) {
+		ringRows = 1;
+	}
+	if (ringRows > mcuRows) {
+		ringRows = mcuRows;
+	}
+	MCU* ring = new (std::nothrow) MCU[ringRows * mcuColumns];
+	if (ring == nullptr) {
+		std::cout << "Error: Decoder error, mcu ring is null\n";
+		return false;
+	}
+	generateAllHuffmanCodes(jpeg);
+	const DecodeMCURangeKernel decodeKernel = selectDecodeKernel(jpeg);
+	const ComponentTables tables = resolveComponentTables(jpeg);
+	void (*const processKernel)(const ComponentTables&, MCU* const, uint, const uint) = (jpeg->numComponents == 1) ? processMCUs<1> : processMCUs<3>;
+
+	std::mutex mutex;
+	std::condition_variable rowStateChanged;
+	std::vector<bool> rowReady(mcuRows, false);
+	uint rowsWritten = 0;
+	uint rowsSubmitted = 0;
+	uint rowsProcessed = 0;
+	bool failed = false;
+
+	std::thread entropyThread([&]() {
+		BitReader bitReader(jpeg->huffmanData);
+		int prevDCCoefficients[3] = { 0 };
+		for (uint row = 0; row < mcuRows; ++row) {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				rowStateChanged.wait(lock, [&]() { return row < rowsWritten + ringRows || failed; });
+				if (failed) {
+					return;
+				}
+			}
+			MCU* const slot = ring + (row % ringRows) * mcuColumns;
+			if (!decodeKernel(bitReader, jpeg, prevDCCoefficients, slot, row * mcuColumns, mcuColumns, true)) {
+				std::lock_guard<std::mutex> lock(mutex);
+				failed = true;
+				rowStateChanged.notify_all();
+				return;
+			}
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				rowsSubmitted += 1;
+			}
+			pool.submit([&, row, slot]() {
+				processKernel(tables, slot, mcuColumns, blockSize);
+				std::lock_guard<std::mutex> lock(mutex);
+				rowReady[row] = true;
+				rowsProcessed += 1;
+				rowStateChanged.notify_all();
+			});
+		}
+	});
+
+	for (uint row = 0; row < mcuRows; ++row) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			rowStateChanged.wait(lock, [&]() { return rowReady[row] || failed; });
+			if (failed) {
+				break;
+			}
+		}
+		writeRow(row, ring + (row % ringRows) * mcuColumns);
+		std::lock_guard<std::mutex> lock(mutex);
+		rowsWritten += 1;
+		rowStateChanged.notify_all();
+	}
+
+	entropyThread.join();
+	{
+		// Rows already handed to the pool still reference the ring
+		std::unique_lock<std::mutex> lock(mutex);
+		rowStateChanged.wait(lock, [&]() { return rowsProcessed == rowsSubmitted; });
+	}
+	delete[] ring;
+	return !failed;
 }
\ No newline at end of file
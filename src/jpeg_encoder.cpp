@@ -0,0 +1,473 @@
+#include "../include/jpeg.h"
+#include "../include/bit_writer.h"
+#include "../include/thread_pool.h"
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <algorithm>
+
+void generateHuffmanCodes(HuffmanTable&);
+
+struct HuffmanEncodeTable {
+	uint codes[256] = { 0 };
+	byte lengths[256] = { 0 };
+};
+
+void buildHuffmanTable(HuffmanTable& table, const byte* const counts, const byte* const symbols) {
+	table.offsets[0] = 0;
+	uint allSymbols = 0;
+	for (uint i = 1; i <= 16; ++i) {
+		allSymbols += counts[i - 1];
+		table.offsets[i] = allSymbols;
+	}
+	for (uint i = 0; i < allSymbols; ++i) {
+		table.symbols[i] = symbols[i];
+	}
+	table.set = true;
+}
+
+void buildEncodeTable(HuffmanTable& table, HuffmanEncodeTable& encodeTable) {
+	generateHuffmanCodes(table);
+	for (uint i = 0; i < 16; ++i) {
+		for (uint j = table.offsets[i]; j < table.offsets[i + 1]; ++j) {
+			encodeTable.codes[table.symbols[j]] = table.codes[j];
+			encodeTable.lengths[table.symbols[j]] = i + 1;
+		}
+	}
+}
+
+// Builds a length limited Huffman table from symbol frequencies (Annex K.2, same procedure as the IJG encoder).
+// frequencies holds 257 entries, the last one is reserved so no code consists of only 1 bits.
+void buildOptimalHuffmanTable(const uint* const symbolFrequencies, HuffmanTable& table) {
+	long long frequencies[257];
+	int codeSize[257] = { 0 };
+	int others[257];
+	for (uint i = 0; i < 257; ++i) {
+		frequencies[i] = symbolFrequencies[i];
+		others[i] = -1;
+	}
+	frequencies[256] = 1;
+
+	while (true) {
+		// c1 is the least frequent symbol, c2 the next least frequent
+		int c1 = -1;
+		int c2 = -1;
+		long long v = 1LL << 62;
+		for (int i = 0; i <= 256; ++i) {
+			if (frequencies[i] != 0 && frequencies[i] <= v) {
+				v = frequencies[i];
+				c1 = i;
+			}
+		}
+		v = 1LL << 62;
+		for (int i = 0; i <= 256; ++i) {
+			if (frequencies[i] != 0 && frequencies[i] <= v && i != c1) {
+				v = frequencies[i];
+				c2 = i;
+			}
+		}
+		if (c2 < 0) {
+			break;
+		}
+
+		frequencies[c1] += frequencies[c2];
+		frequencies[c2] = 0;
+		codeSize[c1] += 1;
+		while (others[c1] >= 0) {
+			c1 = others[c1];
+			codeSize[c1] += 1;
+		}
+		others[c1] = c2;
+		codeSize[c2] += 1;
+		while (others[c2] >= 0) {
+			c2 = others[c2];
+			codeSize[c2] += 1;
+		}
+	}
+
+	uint bits[33] = { 0 };
+	for (uint i = 0; i <= 256; ++i) {
+		if (codeSize[i] != 0) {
+			bits[codeSize[i]] += 1;
+		}
+	}
+	// Limit code lengths to 16 bits by moving pairs of leaves up the tree
+	for (uint i = 32; i > 16; --i) {
+		while (bits[i] > 0) {
+			uint j = i - 2;
+			while (bits[j] == 0) {
+				j -= 1;
+			}
+			bits[i] -= 2;
+			bits[i - 1] += 1;
+			bits[j + 1] += 2;
+			bits[j] -= 1;
+		}
+	}
+	// Drop the reserved symbol, it always has the longest code
+	uint longest = 16;
+	while (bits[longest] == 0) {
+		longest -= 1;
+	}
+	bits[longest] -= 1;
+
+	byte counts[16];
+	for (uint i = 0; i < 16; ++i) {
+		counts[i] = bits[i + 1];
+	}
+	byte symbols[256];
+	uint symbolCount = 0;
+	for (int length = 1; length <= 32; ++length) {
+		for (uint j = 0; j < 256; ++j) {
+			if (codeSize[j] == length) {
+				symbols[symbolCount++] = j;
+			}
+		}
+	}
+	buildHuffmanTable(table, counts, symbols);
+}
+
+void scaleQuantizationTable(const byte* const base, uint quality, QuantizationTable& table) {
+	quality = std::min(std::max(quality, 1u), 100u);
+	const uint scale = (quality < 50) ? (5000 / quality) : (200 - quality * 2);
+	for (uint i = 0; i < 64; ++i) {
+		uint value = (base[i] * scale + 50) / 100;
+		table.table[i] = std::min(std::max(value, 1u), 255u);
+	}
+	table.set = true;
+}
+
+// True when re-encoding at this quality would reproduce the source quantization tables,
+// in which case the coefficients can be copied over without touching the pixels
+bool quantizationTablesMatch(const JPEGImage* const jpeg, const uint quality) {
+	QuantizationTable scaled[2];
+	scaleQuantizationTable(standardLuminanceQuantization, quality, scaled[0]);
+	scaleQuantizationTable(standardChrominanceQuantization, quality, scaled[1]);
+	for (uint j = 0; j < jpeg->numComponents; ++j) {
+		const QuantizationTable& source = jpeg->quantizationTables[jpeg->colorComponents[j].quantizationTableID];
+		const QuantizationTable& target = scaled[(j == 0) ? 0 : 1];
+		if (!std::equal(source.table, source.table + 64, target.table)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// 1D AAN forward DCT down all 8 columns at once. Every statement works on 8 independent lanes laid out
+// contiguously, so the loop vectorizes. The outputs carry the AAN scale factors, quantization removes them.
+void forwardDCTColumns(float* const block) {
+	for (uint i = 0; i < 8; ++i) {
+		const float tmp0 = block[0 * 8 + i] + block[7 * 8 + i];
+		const float tmp7 = block[0 * 8 + i] - block[7 * 8 + i];
+		const float tmp1 = block[1 * 8 + i] + block[6 * 8 + i];
+		const float tmp6 = block[1 * 8 + i] - block[6 * 8 + i];
+		const float tmp2 = block[2 * 8 + i] + block[5 * 8 + i];
+		const float tmp5 = block[2 * 8 + i] - block[5 * 8 + i];
+		const float tmp3 = block[3 * 8 + i] + block[4 * 8 + i];
+		const float tmp4 = block[3 * 8 + i] - block[4 * 8 + i];
+
+		// Even part
+		const float tmp10 = tmp0 + tmp3;
+		const float tmp13 = tmp0 - tmp3;
+		const float tmp11 = tmp1 + tmp2;
+		const float tmp12 = tmp1 - tmp2;
+
+		block[0 * 8 + i] = tmp10 + tmp11;
+		block[4 * 8 + i] = tmp10 - tmp11;
+
+		const float z1 = (tmp12 + tmp13) * (m1 / 2.0f);
+		block[2 * 8 + i] = tmp13 + z1;
+		block[6 * 8 + i] = tmp13 - z1;
+
+		// Odd part
+		const float odd10 = tmp4 + tmp5;
+		const float odd11 = tmp5 + tmp6;
+		const float odd12 = tmp6 + tmp7;
+
+		const float z5 = (odd10 - odd12) * (m5 / 2.0f);
+		const float z2 = odd10 * (m2 / 2.0f) + z5;
+		const float z4 = odd12 * (m4 / 2.0f) + z5;
+		const float z3 = odd11 * (m1 / 2.0f);
+
+		const float z11 = tmp7 + z3;
+		const float z13 = tmp7 - z3;
+
+		block[5 * 8 + i] = z13 + z2;
+		block[3 * 8 + i] = z13 - z2;
+		block[1 * 8 + i] = z11 + z4;
+		block[7 * 8 + i] = z11 - z4;
+	}
+}
+
+void transposeBlock(float* const block) {
+	for (uint i = 0; i < 8; ++i) {
+		for (uint j = i + 1; j < 8; ++j) {
+			std::swap(block[i * 8 + j], block[j * 8 + i]);
+		}
+	}
+}
+
+void forwardDCTComp(float* const block) {
+	forwardDCTColumns(block);
+	transposeBlock(block);
+	forwardDCTColumns(block);
+	transposeBlock(block);
+}
+
+// Reciprocal of quantization step times the AAN output scale 8 * aan(u) * aan(v), where aan(k) = 2 * sqrt(2) * s(k)
+void quantizationDivisors(const QuantizationTable& qt, float* const divisors) {
+	const float s[8] = { s0, s1, s2, s3, s4, s5, s6, s7 };
+	for (uint u = 0; u < 8; ++u) {
+		for (uint v = 0; v < 8; ++v) {
+			divisors[u * 8 + v] = 1.0f / (qt.table[u * 8 + v] * 64.0f * s[u] * s[v]);
+		}
+	}
+}
+
+void quantizeComponent(const float* const block, const float* const divisors, int* const component) {
+	for (uint i = 0; i < 64; ++i) {
+		// Baseline AC coefficients are limited to 10 bits
+		component[i] = std::min(std::max((int)std::lround(block[i] * divisors[i]), -1023), 1023);
+	}
+}
+
+// Converts RGB MCUs to YCbCr, applies the forward DCT and quantizes at the given quality.
+// The result uses the Annex K tables scaled to quality: table 0 for luminance, table 1 for chrominance.
+CoefficientImage* forwardTransform(const MCU* const mcus, const JPEGImage* const jpeg, const uint quality, ThreadPool* const pool) {
+	const uint mcuRows = (jpeg->height + 7) / 8;
+	const uint mcuColumns = (jpeg->width + 7) / 8;
+	CoefficientImage* image = new (std::nothrow) CoefficientImage;
+	if (image == nullptr) {
+		std::cout << "Error: Encoder error, coefficient image is null\n";
+		return nullptr;
+	}
+	image->height = jpeg->height;
+	image->width = jpeg->width;
+	image->numComponents = jpeg->numComponents;
+	scaleQuantizationTable(standardLuminanceQuantization, quality, image->quantizationTables[0]);
+	scaleQuantizationTable(standardChrominanceQuantization, quality, image->quantizationTables[1]);
+	for (uint j = 0; j < image->numComponents; ++j) {
+		CoefficientPlane& plane = image->planes[j];
+		plane.blocksWide = mcuColumns;
+		plane.blocksHigh = mcuRows;
+		plane.quantizationTableID = (j == 0) ? 0 : 1;
+		plane.coefficients.assign((size_t)mcuRows * mcuColumns * 64, 0);
+	}
+	float divisors[2][64];
+	quantizationDivisors(image->quantizationTables[0], divisors[0]);
+	quantizationDivisors(image->quantizationTables[1], divisors[1]);
+
+	const std::function<void(uint, uint)> rowTask = [&](uint firstRow, uint lastRow) {
+		float blocks[3][64];
+		for (uint i = firstRow * mcuColumns; i < lastRow * mcuColumns; ++i) {
+			const MCU& mcu = mcus[i];
+			for (uint k = 0; k < 64; ++k) {
+				const float r = (float)mcu.r[k];
+				const float g = (float)mcu.g[k];
+				const float b = (float)mcu.b[k];
+				blocks[0][k] = 0.299f * r + 0.587f * g + 0.114f * b - 128.0f;
+				blocks[1][k] = -0.168736f * r - 0.331264f * g + 0.5f * b;
+				blocks[2][k] = 0.5f * r - 0.418688f * g - 0.081312f * b;
+			}
+			for (uint j = 0; j < image->numComponents; ++j) {
+				forwardDCTComp(blocks[j]);
+				quantizeComponent(blocks[j], divisors[image->planes[j].quantizationTableID], &image->planes[j].coefficients[(size_t)i * 64]);
+			}
+		}
+	};
+	if (pool == nullptr) {
+		rowTask(0, mcuRows);
+	}
+	else {
+		pool->parallelFor(mcuRows, rowTask);
+	}
+	return image;
+}
+
+uint bitLength(uint value) {
+	uint length = 0;
+	while (value != 0) {
+		length += 1;
+		value >>= 1;
+	}
+	return length;
+}
+
+// Walks one block in zig-zag order and hands every Huffman symbol to emit(isAC, symbol, extraBits, extraLength)
+template <typename Emit>
+void emitBlockSymbols(const int* const component, const bool zigZagOrder, int& prevDC, Emit emit) {
+	const int difference = component[0] - prevDC;
+	prevDC = component[0];
+	uint length = bitLength((uint)std::abs(difference));
+	emit(false, length, (uint)(difference < 0 ? difference - 1 : difference), length);
+
+	uint zeros = 0;
+	for (uint i = 1; i < 64; ++i) {
+		const int coefficient = component[zigZagOrder ? i : zigZagMap[i]];
+		if (coefficient == 0) {
+			zeros += 1;
+			continue;
+		}
+		while (zeros >= 16) {
+			emit(true, 0xF0, 0, 0);
+			zeros -= 16;
+		}
+		length = bitLength((uint)std::abs(coefficient));
+		emit(true, (zeros << 4) | length, (uint)(coefficient < 0 ? coefficient - 1 : coefficient), length);
+		zeros = 0;
+	}
+	if (zeros != 0) {
+		emit(true, 0x00, 0, 0);
+	}
+}
+
+void putMarkerLength(std::vector<byte>& out, const byte marker, const uint length) {
+	out.push_back(0xFF);
+	out.push_back(marker);
+	out.push_back((length >> 8) & 0xFF);
+	out.push_back(length & 0xFF);
+}
+
+// Entropy codes a coefficient image into a baseline JPEG. The coefficients are taken as-is, so re-encoding a decoded
+// CoefficientImage is lossless. optimizeHuffman builds tables from a symbol histogram in a first pass instead of
+// using the Annex K tables, restartInterval (in MCUs) adds RST markers when non-zero.
+bool encodeCoefficients(const std::string& savefile_name, const CoefficientImage* const image, const bool optimizeHuffman, const uint restartInterval) {
+	const uint blocksWide = image->planes[0].blocksWide;
+	const uint blockCount = blocksWide * image->planes[0].blocksHigh;
+	const uint tableCount = (image->numComponents == 1) ? 1 : 2;
+
+	HuffmanTable dcTables[2];
+	HuffmanTable acTables[2];
+	if (optimizeHuffman) {
+		uint dcFrequencies[2][257] = { { 0 } };
+		uint acFrequencies[2][257] = { { 0 } };
+		int prevDC[3] = { 0 };
+		for (uint i = 0; i < blockCount; ++i) {
+			if (restartInterval != 0 && i % restartInterval == 0) {
+				prevDC[0] = prevDC[1] = prevDC[2] = 0;
+			}
+			for (uint j = 0; j < image->numComponents; ++j) {
+				const uint t = (j == 0) ? 0 : 1;
+				emitBlockSymbols(&image->planes[j].coefficients[(size_t)i * 64], image->zigZagOrder, prevDC[j],
+					[&](bool isAC, uint symbol, uint, uint) {
+						(isAC ? acFrequencies : dcFrequencies)[t][symbol] += 1;
+					});
+			}
+		}
+		for (uint t = 0; t < tableCount; ++t) {
+			buildOptimalHuffmanTable(dcFrequencies[t], dcTables[t]);
+			buildOptimalHuffmanTable(acFrequencies[t], acTables[t]);
+		}
+	}
+	else {
+		buildHuffmanTable(dcTables[0], standardDCLuminanceCounts, standardDCLuminanceSymbols);
+		buildHuffmanTable(acTables[0], standardACLuminanceCounts, standardACLuminanceSymbols);
+		buildHuffmanTable(dcTables[1], standardDCChrominanceCounts, standardDCChrominanceSymbols);
+		buildHuffmanTable(acTables[1], standardACChrominanceCounts, standardACChrominanceSymbols);
+	}
+	HuffmanEncodeTable dcEncodeTables[2];
+	HuffmanEncodeTable acEncodeTables[2];
+	for (uint t = 0; t < tableCount; ++t) {
+		buildEncodeTable(dcTables[t], dcEncodeTables[t]);
+		buildEncodeTable(acTables[t], acEncodeTables[t]);
+	}
+
+	std::vector<byte> out;
+	out.push_back(0xFF);
+	out.push_back(SOI);
+
+	// JFIF APP0 segment
+	const byte jfif[] = { 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0 };
+	putMarkerLength(out, APP0, 2 + sizeof(jfif));
+	out.insert(out.end(), jfif, jfif + sizeof(jfif));
+
+	bool tableWritten[4] = { false };
+	for (uint j = 0; j < image->numComponents; ++j) {
+		const byte tableID = image->planes[j].quantizationTableID;
+		if (tableWritten[tableID]) {
+			continue;
+		}
+		tableWritten[tableID] = true;
+		const QuantizationTable& qt = image->quantizationTables[tableID];
+		const bool wide = *std::max_element(qt.table, qt.table + 64) > 255;
+		putMarkerLength(out, DQT, 2 + 1 + (wide ? 128 : 64));
+		out.push_back((wide ? 0x10 : 0x00) | tableID);
+		for (uint k = 0; k < 64; ++k) {
+			const uint value = qt.table[image->zigZagOrder ? k : zigZagMap[k]];
+			if (wide) {
+				out.push_back((value >> 8) & 0xFF);
+			}
+			out.push_back(value & 0xFF);
+		}
+	}
+
+	putMarkerLength(out, SOF0, 8 + 3 * image->numComponents);
+	out.push_back(8);
+	out.push_back((image->height >> 8) & 0xFF);
+	out.push_back(image->height & 0xFF);
+	out.push_back((image->width >> 8) & 0xFF);
+	out.push_back(image->width & 0xFF);
+	out.push_back(image->numComponents);
+	for (uint j = 0; j < image->numComponents; ++j) {
+		out.push_back(j + 1);
+		out.push_back(0x11);
+		out.push_back(image->planes[j].quantizationTableID);
+	}
+
+	for (uint t = 0; t < tableCount; ++t) {
+		for (uint ac = 0; ac < 2; ++ac) {
+			const HuffmanTable& table = ac ? acTables[t] : dcTables[t];
+			putMarkerLength(out, DHT, 2 + 1 + 16 + table.offsets[16]);
+			out.push_back((ac << 4) | t);
+			for (uint i = 0; i < 16; ++i) {
+				out.push_back(table.offsets[i + 1] - table.offsets[i]);
+			}
+			out.insert(out.end(), table.symbols, table.symbols + table.offsets[16]);
+		}
+	}
+
+	if (restartInterval != 0) {
+		putMarkerLength(out, DRI, 4);
+		out.push_back((restartInterval >> 8) & 0xFF);
+		out.push_back(restartInterval & 0xFF);
+	}
+
+	putMarkerLength(out, SOS, 6 + 2 * image->numComponents);
+	out.push_back(image->numComponents);
+	for (uint j = 0; j < image->numComponents; ++j) {
+		const uint t = (j == 0) ? 0 : 1;
+		out.push_back(j + 1);
+		out.push_back((t << 4) | t);
+	}
+	out.push_back(0);
+	out.push_back(63);
+	out.push_back(0);
+
+	BitWriter bitWriter(out);
+	int prevDC[3] = { 0 };
+	for (uint i = 0; i < blockCount; ++i) {
+		if (restartInterval != 0 && i % restartInterval == 0 && i != 0) {
+			bitWriter.writeMarker(RST0 + (i / restartInterval - 1) % 8);
+			prevDC[0] = prevDC[1] = prevDC[2] = 0;
+		}
+		for (uint j = 0; j < image->numComponents; ++j) {
+			const uint t = (j == 0) ? 0 : 1;
+			emitBlockSymbols(&image->planes[j].coefficients[(size_t)i * 64], image->zigZagOrder, prevDC[j],
+				[&](bool isAC, uint symbol, uint extraBits, uint extraLength) {
+					const HuffmanEncodeTable& table = isAC ? acEncodeTables[t] : dcEncodeTables[t];
+					bitWriter.writeBits(table.codes[symbol], table.lengths[symbol]);
+					bitWriter.writeBits(extraBits, extraLength);
+				});
+		}
+	}
+	bitWriter.writeMarker(EOI);
+
+	std::ofstream outFile = std::ofstream(savefile_name, std::ios::out | std::ios::binary);
+	if (!outFile.is_open()) {
+		std::cout << "Error: Could not open output file\n";
+		return false;
+	}
+	outFile.write((const char*)out.data(), (std::streamsize)out.size());
+	outFile.close();
+	return true;
+}
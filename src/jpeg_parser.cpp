@@ -2,14 +2,19 @@
 #include <iostream>
 #include <fstream>
 #include "../include/error_handler.h"
+#include "../include/byte_reader.h"
+#include "../include/file_io.h"
 
+void parseExif(const std::vector<byte>&, ExifData&);
+void buildHuffmanTable(HuffmanTable&, const byte* const, const byte* const);
 
-void parseQT(std::ifstream& inFile, JPEGImage* const jpeg) {
+
+void parseQT(ByteReader& reader, JPEGImage* const jpeg) {
 	std::cout << "Parsing DQT Marker\n";
-	int length = (inFile.get() << 8) | inFile.get();
+	int length = (reader.get() << 8) | reader.get();
 	length -= 2;
 	while (length > 0) {
-		byte tableInfo = inFile.get(); // lower nibble holds table id, upper nibble holds the amount of bits
+		byte tableInfo = reader.get(); // lower nibble holds table id, upper nibble holds the amount of bits
 		length -= 1;
 		byte tableID = tableInfo & 0x0F;
 		if (tableID > 3) {
@@ -19,13 +24,13 @@ void parseQT(std::ifstream& inFile, JPEGImage* const jpeg) {
 		jpeg->quantizationTables[tableID].set = true;
 		if (tableInfo >> 4 != 0) { // 16-bit quantization table
 			for (uint i = 0; i < 64; ++i) {
-				jpeg->quantizationTables[tableID].table[zigZagMap[i]] = (inFile.get() << 8) | inFile.get();
+				jpeg->quantizationTables[tableID].table[zigZagMap[i]] = (reader.get() << 8) | reader.get();
 			}
 			length -= 128;
 		}
 		else { // 8-bit quantization table
 			for (uint i = 0; i < 64; ++i) {
-				jpeg->quantizationTables[tableID].table[zigZagMap[i]] = inFile.get();
+				jpeg->quantizationTables[tableID].table[zigZagMap[i]] = reader.get();
 			}
 			length -= 64;
 		}
@@ -35,48 +40,62 @@ void parseQT(std::ifstream& inFile, JPEGImage* const jpeg) {
 	}
 }
 
-void parseAPPN(std::ifstream& inFile, JPEGImage* const jpeg) {
+void parseAPPN(ByteReader& reader, JPEGImage* const jpeg, const byte marker) {
 	std::cout << "Parsing APPN Marker\n";
-	uint length = (inFile.get() << 8) | inFile.get();
+	uint length = (reader.get() << 8) | reader.get();
+	if (length < 2) {
+		ErrorHandler::logJPEGError("Error: Invalid APPN Length\n", jpeg->isValid);
+		return;
+	}
+	if (marker != APP1) {
+		for (uint i = 0; i < length - 2; ++i) {
+			reader.get();
+		}
+		return;
+	}
+	// APP1 may carry EXIF, keep the payload long enough to pull the metadata out of it
+	std::vector<byte> payload;
+	payload.reserve(length - 2);
 	for (uint i = 0; i < length - 2; ++i) {
-		inFile.get();
+		payload.push_back(reader.get());
 	}
+	parseExif(payload, jpeg->exif);
 }
 
-void parseCOM(std::ifstream& inFile, JPEGImage* const jpeg) {
+void parseCOM(ByteReader& reader, JPEGImage* const jpeg) {
 	std::cout << "Parsing COM Marker\n";
-	uint length = (inFile.get() << 8) | inFile.get();
+	uint length = (reader.get() << 8) | reader.get();
 	for (uint i = 0; i < length - 2; ++i) {
-		inFile.get();
+		reader.get();
 	}
 }
 
-void parseSOF(std::ifstream& inFile, JPEGImage* const jpeg) {
+void parseSOF(ByteReader& reader, JPEGImage* const jpeg) {
 	std::cout << "Parsing SOF Marker\n";
 	if (jpeg->numComponents != 0) {
 		ErrorHandler::logJPEGError("Error: Duplicate SOF Markers\n", jpeg->isValid);
 		return;
 	}
-	uint length = (inFile.get() << 8) | inFile.get();
-	byte precision = inFile.get();
+	uint length = (reader.get() << 8) | reader.get();
+	byte precision = reader.get();
 	if (precision != 8) {
 		ErrorHandler::logJPEGError("Error: Invalid precision. Must be 8, received " + std::to_string((uint)precision) + "\n", jpeg->isValid);
 		return;
 	}
 
-	jpeg->height = (inFile.get() << 8) | inFile.get();
-	jpeg->width = (inFile.get() << 8) | inFile.get();
+	jpeg->height = (reader.get() << 8) | reader.get();
+	jpeg->width = (reader.get() << 8) | reader.get();
 	if (jpeg->height == 0 || jpeg->width == 0){
 		ErrorHandler::logJPEGError("Error: Invalid dimensions\n", jpeg->isValid);
 		return;
 	}
-	jpeg->numComponents = inFile.get();
+	jpeg->numComponents = reader.get();
 	if (jpeg->numComponents != 3 && jpeg->numComponents != 1) {
 		ErrorHandler::logJPEGError("Error: Invalid number of components", jpeg->isValid);
 		return;
 	}
 	for (uint i = 0; i < jpeg->numComponents; ++i) {
-		byte componentID = inFile.get();
+		byte componentID = reader.get();
 		// Component ID can be 1, 2 or 3 in YCrCb Color mode
 		// In rare cases ID can be 0, 1 or 2, So we force it to the range 1, 2 and 3
 		if (componentID == 0) {
@@ -99,7 +118,7 @@ void parseSOF(std::ifstream& inFile, JPEGImage* const jpeg) {
 			return;
 		}
 		component->used = true;
-		byte samplingFactor = inFile.get();
+		byte samplingFactor = reader.get();
 		component->componentID = componentID;
 		component->horizontalSamplingFactor = samplingFactor >> 4;
 		component->verticalSamplingFactor = samplingFactor & 0x0F;
@@ -108,7 +127,7 @@ void parseSOF(std::ifstream& inFile, JPEGImage* const jpeg) {
 		//	jpeg->isValid = false;
 		//	return;
 		//}
-		component->quantizationTableID = inFile.get();
+		component->quantizationTableID = reader.get();
 		if (component->quantizationTableID > 3) {
 			ErrorHandler::logJPEGError("Error: Component " + std::to_string((uint)componentID) + " is referencing an invalid QT ID: " + std::to_string((uint)component->quantizationTableID) + "\n", jpeg->isValid);
 			return;
@@ -119,21 +138,21 @@ void parseSOF(std::ifstream& inFile, JPEGImage* const jpeg) {
 	}
 }
 
-void parseRI(std::ifstream& inFile, JPEGImage* const jpeg) {
+void parseRI(ByteReader& reader, JPEGImage* const jpeg) {
 	std::cout << "Parsing DRI Marker\n";
-	uint length = (inFile.get() << 8) | inFile.get();
+	uint length = (reader.get() << 8) | reader.get();
 	if (length != 4) {
 		ErrorHandler::logJPEGError("Error: Invalid DRI Length\n", jpeg->isValid);
 	}
-	jpeg->restartInterval = (inFile.get() << 8) | inFile.get();
+	jpeg->restartInterval = (reader.get() << 8) | reader.get();
 }
 
-void parseHT(std::ifstream& inFile, JPEGImage* const jpeg) {
+void parseHT(ByteReader& reader, JPEGImage* const jpeg) {
 	std::cout << "Parsing DHT Marker\n";
-	int length = (inFile.get() << 8) | inFile.get();
+	int length = (reader.get() << 8) | reader.get();
 	length -= 2;
 	while (length > 0) {
-		byte tableInfo = inFile.get();
+		byte tableInfo = reader.get();
 		byte tableID = tableInfo & 0x0F;
 		bool ACTable = tableInfo >> 4;
 		if (tableID > 3) {
@@ -142,18 +161,29 @@ void parseHT(std::ifstream& inFile, JPEGImage* const jpeg) {
 		}
 		HuffmanTable* hTable = (ACTable) ? (&jpeg->huffmanACTables[tableID]) : (&jpeg->huffmanDCTables[tableID]);
 		hTable->set = true;
+		hTable->lookup.reset();
 		hTable->offsets[0] = 0;
 		uint allSymbols = 0;
+		// Codes of each length follow the previous length's, there must be no more than the length can hold (Kraft inequality)
+		uint code = 0;
+		bool oversubscribed = false;
 		for (uint i = 1; i <= 16; ++i) {
-			allSymbols += inFile.get();
+			const uint count = reader.get();
+			allSymbols += count;
 			hTable->offsets[i] = allSymbols;
+			code = (code << 1) + count;
+			oversubscribed = oversubscribed || code > (1u << i);
 		}
-		if (allSymbols > 176) {
+		if (allSymbols > 162) {
 			ErrorHandler::logJPEGError("Error: Too many symbols in Huffman Table\n", jpeg->isValid);
 			return;
 		}
+		if (oversubscribed) {
+			ErrorHandler::logJPEGError("Error: Huffman Table has more codes than fit their lengths\n", jpeg->isValid);
+			return;
+		}
 		for (uint i = 0; i < allSymbols; ++i) {
-			hTable->symbols[i] = inFile.get();
+			hTable->symbols[i] = reader.get();
 		}
 		length -= 17 + allSymbols;
 	}
@@ -162,19 +192,19 @@ void parseHT(std::ifstream& inFile, JPEGImage* const jpeg) {
 	}
 }
 
-void parseSOS(std::ifstream& inFile, JPEGImage* const jpeg) {
+void parseSOS(ByteReader& reader, JPEGImage* const jpeg) {
 	std::cout << "Parsing SOS Marker\n";
 	if (jpeg->numComponents == 0) {
 		ErrorHandler::logJPEGError("Error: SOS Marker can't appear before SOF Marker\n", jpeg->isValid);
 		return;
 	}
-	uint length = (inFile.get() << 8) | inFile.get();
+	uint length = (reader.get() << 8) | reader.get();
 	for (uint i = 0; i < jpeg->numComponents; ++i) {
 		jpeg->colorComponents[i].used = false;
 	}
-	byte numOfComponents = inFile.get();
+	byte numOfComponents = reader.get();
 	for (uint i = 0; i < numOfComponents; ++i) {
-		byte componentID = inFile.get();
+		byte componentID = reader.get();
 		if (jpeg->zeroBased) {
 			componentID += 1;
 		}
@@ -188,7 +218,7 @@ void parseSOS(std::ifstream& inFile, JPEGImage* const jpeg) {
 			return;
 		}
 		colorComponent->used = true;
-		byte huffmanTableIDs = inFile.get();
+		byte huffmanTableIDs = reader.get();
 		colorComponent->huffmanDCTableID = huffmanTableIDs >> 4;
 		colorComponent->huffmanACTableID = huffmanTableIDs & 0x0F;
 		if (colorComponent->huffmanACTableID > 3 || colorComponent->huffmanDCTableID > 3) {
@@ -199,9 +229,9 @@ void parseSOS(std::ifstream& inFile, JPEGImage* const jpeg) {
 
 	// Spectral selection and successive approximation bytes:
 	// in baseline: start = 0, end = 63, succcessiveApprox = 00 (0 for high and low byte)
-	jpeg->startOfSelection = inFile.get();
-	jpeg->endOfSelection = inFile.get();
-	byte successiveApprox = inFile.get();
+	jpeg->startOfSelection = reader.get();
+	jpeg->endOfSelection = reader.get();
+	byte successiveApprox = reader.get();
 	jpeg->successiveApproximationHigh = successiveApprox >> 4;
 	jpeg->successiveApproximationLow = successiveApprox & 0x0F;
 
@@ -227,129 +257,210 @@ void parseSOS(std::ifstream& inFile, JPEGImage* const jpeg) {
 	}
 }
 
-JPEGImage* parseJPEG(const std::string& filename) {
-	std::ifstream inFile = std::ifstream(filename, std::ios::in | std::ios::binary);
-	if (!inFile.is_open()) {
-		std::cout << "Error: Could not open file\n";
-		return nullptr;
-	}
-	JPEGImage* jpeg = new (std::nothrow) JPEGImage;
-	if (jpeg == nullptr) {
-		std::cout << "Error: jpeg is null pointer\n";
-		inFile.close();
-		return nullptr;
+// Motion JPEG frames usually leave out DHT and imply the Annex K tables, luminance for table 0 and chrominance otherwise.
+// Fills in whichever table the scan refers to that was never defined.
+void applyDefaultHuffmanTables(JPEGImage* const jpeg) {
+	for (uint i = 0; i < jpeg->numComponents; ++i) {
+		const ColorComponent& component = jpeg->colorComponents[i];
+		HuffmanTable& dcTable = jpeg->huffmanDCTables[component.huffmanDCTableID];
+		HuffmanTable& acTable = jpeg->huffmanACTables[component.huffmanACTableID];
+		if (!dcTable.set) {
+			std::cout << "Using the standard DC Huffman table " << (uint)component.huffmanDCTableID << "\n";
+			if (component.huffmanDCTableID == 0) {
+				buildHuffmanTable(dcTable, standardDCLuminanceCounts, standardDCLuminanceSymbols);
+			}
+			else {
+				buildHuffmanTable(dcTable, standardDCChrominanceCounts, standardDCChrominanceSymbols);
+			}
+		}
+		if (!acTable.set) {
+			std::cout << "Using the standard AC Huffman table " << (uint)component.huffmanACTableID << "\n";
+			if (component.huffmanACTableID == 0) {
+				buildHuffmanTable(acTable, standardACLuminanceCounts, standardACLuminanceSymbols);
+			}
+			else {
+				buildHuffmanTable(acTable, standardACChrominanceCounts, standardACChrominanceSymbols);
+			}
+		}
 	}
-	byte last = inFile.get();
-	byte current = inFile.get();
+}
+
+// Parses SOI and every marker segment up to and including SOS, leaving reader at the first byte of scan data
+void parseHeaders(ByteReader& reader, JPEGImage* const jpeg) {
+	byte last = reader.get();
+	byte current = reader.get();
 	if (last != 0xFF || current != SOI) {
-		ErrorHandler::logJPEGError("Invalid Beginning of JPEG\n", jpeg->isValid, inFile);
-		return jpeg;
+		ErrorHandler::logJPEGError("Invalid Beginning of JPEG\n", jpeg->isValid);
+		return;
 	}
-	last = inFile.get();
-	current = inFile.get();
+	last = reader.get();
+	current = reader.get();
 	while (jpeg->isValid) {
-		if (!inFile) {
-			ErrorHandler::logJPEGError("Error: Invalid end of JPEG\n", jpeg->isValid, inFile);
-			return jpeg;
+		if (!reader) {
+			ErrorHandler::logJPEGError("Error: Invalid end of JPEG\n", jpeg->isValid);
+			return;
 		}
 		if (last != 0xFF) {
-			ErrorHandler::logJPEGError("Error: Expected a marker\n", jpeg->isValid, inFile);
-			return jpeg;
+			ErrorHandler::logJPEGError("Error: Expected a marker\n", jpeg->isValid);
+			return;
 		}
 		if (current >= APP0 && current <= APP15) { // APPN Discarding
-			parseAPPN(inFile, jpeg);
+			parseAPPN(reader, jpeg, current);
 		}
 		else if (current == DQT) { // Define Quantization Table
-			parseQT(inFile, jpeg);
+			parseQT(reader, jpeg);
 
 		}
 		else if (current == DRI){ // Define Restart Interval
-			parseRI(inFile, jpeg);
+			parseRI(reader, jpeg);
 		}
 		else if (current == SOS) { // Start of Scan
-			parseSOS(inFile, jpeg);
+			parseSOS(reader, jpeg);
+			if (jpeg->isValid) {
+				applyDefaultHuffmanTables(jpeg);
+			}
 			break;
 		}
 		else if (current == DHT) { // Define Huffman Table
-			parseHT(inFile, jpeg);
+			parseHT(reader, jpeg);
 		}
 		else if (current == SOF0) { // Start of Frame0
 			jpeg->frameType = SOF0;
-			parseSOF(inFile, jpeg);
+			parseSOF(reader, jpeg);
 		}
 		else if (current == COM) { // Comment
-			parseCOM(inFile, jpeg);
+			parseCOM(reader, jpeg);
 		}
 		else if ((current >= JPG0 && current <= JPG13) || current == DNL || current == DHP || current == EXP) { // Ignore unused markers
-			parseCOM(inFile, jpeg);
+			parseCOM(reader, jpeg);
 		}
 		else if (current == 0xFF) { // Allows any number of consecutive 0xFF bytes
-			current = inFile.get();
+			current = reader.get();
 			continue;
 		}
 		else if (current == EOI) {
-			ErrorHandler::logJPEGError("Error: EOI Marker before SOS is not allowed\n", jpeg->isValid, inFile);
-			return jpeg;
+			ErrorHandler::logJPEGError("Error: EOI Marker before SOS is not allowed\n", jpeg->isValid);
+			return;
 		}
 		else if (current == SOI) {
-			ErrorHandler::logJPEGError("Error: Embedded JPEGs unsupported\n", jpeg->isValid, inFile);
-			return jpeg;
+			ErrorHandler::logJPEGError("Error: Embedded JPEGs unsupported\n", jpeg->isValid);
+			return;
 		}
 		else if (current == DAC) {
-			ErrorHandler::logJPEGError("Error: Arithmetic mode unsupported\n", jpeg->isValid, inFile);
-			return jpeg;
+			ErrorHandler::logJPEGError("Error: Arithmetic mode unsupported\n", jpeg->isValid);
+			return;
 		}
 		else if (current > SOF0 && current <= SOF15) {
 			ErrorHandler::logJPEGError((std::ostringstream() << "Error: SOF1-15 unsupported, received: " << std::hex << (uint)current << std::dec << "\n").str(),
-				jpeg->isValid, inFile);
-			return jpeg;
+				jpeg->isValid);
+			return;
 		}
 		else if (current >= RST0 && current <= RST7) {
-			ErrorHandler::logJPEGError("Error: RST Marker before SOS is not allowed\n", jpeg->isValid, inFile);
-			return jpeg;
+			ErrorHandler::logJPEGError("Error: RST Marker before SOS is not allowed\n", jpeg->isValid);
+			return;
 		}
 		else{
 			ErrorHandler::logJPEGError((std::ostringstream() << "Error: unknown marker: " << std::hex << (uint)current << std::dec << "\n").str(),
-				jpeg->isValid, inFile);
-			return jpeg;
+				jpeg->isValid);
+			return;
 		}
-		last = inFile.get();
-		current = inFile.get();
+		last = reader.get();
+		current = reader.get();
 	}
-	if (jpeg->isValid) {
-		current = inFile.get();
-		while (true) {
-			if (!inFile) {
-				ErrorHandler::logJPEGError("Error: Bit-Stream prematurely ended\n", jpeg->isValid, inFile);
-				return jpeg;
-			}
+}
 
-			last = current;
-			current = inFile.get();
-			if (last == 0xFF) {
-				if (current == EOI) {
-					break;
-				}
-				else if (current == 0x00) { // overwrite 0x00 with the next byte
-					jpeg->huffmanData.push_back(last);
-					current = inFile.get();
-				}
-				else if (current >= RST0 && current <= RST7) { // overwrite 
-					current = inFile.get();
-				}
-				else if (current == 0xFF) {
-					// Do nothing
-				}
+// Copies the entropy coded data after SOS into jpeg->huffmanData, removing byte stuffing and restart markers
+void parseScanData(ByteReader& reader, JPEGImage* const jpeg) {
+	byte last = 0;
+	byte current = reader.get();
+	while (true) {
+		if (!reader) {
+			ErrorHandler::logJPEGError("Error: Bit-Stream prematurely ended\n", jpeg->isValid);
+			return;
+		}
+
+		last = current;
+		current = reader.get();
+		if (last == 0xFF) {
+			if (current == EOI) {
+				break;
 			}
-			else
-			{
+			else if (current == 0x00) { // overwrite 0x00 with the next byte
 				jpeg->huffmanData.push_back(last);
+				current = reader.get();
+			}
+			else if (current >= RST0 && current <= RST7) { // overwrite 
+				current = reader.get();
+			}
+			else if (current == 0xFF) {
+				// Do nothing
 			}
 		}
+		else
+		{
+			jpeg->huffmanData.push_back(last);
+		}
+	}
+}
+
+JPEGImage* parseJPEG(const std::vector<byte>& data) {
+	ByteReader reader(data);
+	JPEGImage* jpeg = new (std::nothrow) JPEGImage;
+	if (jpeg == nullptr) {
+		std::cout << "Error: jpeg is null pointer\n";
+		return nullptr;
+	}
+	parseHeaders(reader, jpeg);
+	if (jpeg->isValid) {
+		parseScanData(reader, jpeg);
 	}
 	return jpeg;
 }
 
+JPEGImage* parseJPEG(const std::string& filename) {
+	std::vector<byte> data;
+	if (!readFile(filename, data)) {
+		std::cout << "Error: Could not open file\n";
+		return nullptr;
+	}
+	return parseJPEG(data);
+}
+
+// Reads just enough of filename to find its frame header, seeking past every other segment.
+// Quiet on failure, callers only use the result to plan work.
+bool probeFrame(const std::string& filename, uint& width, uint& height, uint& components) {
+	std::ifstream inFile = std::ifstream(filename, std::ios::in | std::ios::binary);
+	if (!inFile.is_open() || inFile.get() != 0xFF || inFile.get() != SOI) {
+		return false;
+	}
+	while (inFile) {
+		int marker = inFile.get();
+		if (marker != 0xFF) {
+			return false;
+		}
+		while (marker == 0xFF) {
+			marker = inFile.get();
+		}
+		if (marker == EOF || marker == SOS || marker == EOI) {
+			return false;
+		}
+		const int length = (inFile.get() << 8) | inFile.get();
+		// SOF0-SOF15 without DHT, JPG and DAC, the layout of the start of every frame header is the same
+		if (marker >= SOF0 && marker <= SOF15 && marker != DHT && marker != JPG && marker != DAC) {
+			inFile.get(); // precision
+			height = (uint)((inFile.get() << 8) | inFile.get());
+			width = (uint)((inFile.get() << 8) | inFile.get());
+			components = (uint)inFile.get();
+			return (bool)inFile;
+		}
+		if (length < 2) {
+			return false;
+		}
+		inFile.seekg(length - 2, std::ios::cur);
+	}
+	return false;
+}
+
 void printjpeg(const JPEGImage* const jpeg) {
 	if (jpeg == nullptr) return;
 	std::cout << "****DQT****\n";
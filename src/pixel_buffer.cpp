@@ -0,0 +1,141 @@
+#include "../include/pixel_buffer.h"
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cstdint>
+
+const byte neutralChroma = 128;
+
+inline byte levelShift(int sample) {
+	sample += 128;
+	return (byte)(sample < 0 ? 0 : (sample > 255 ? 255 : sample));
+}
+
+PixelBuffer::PixelBuffer(PixelFormat format, uint width, uint height, size_t stride, uint alignment) :
+	format(format), width(width), height(height), bytesPerPixel((format == PixelFormat::BGRA32) ? 4 : 1),
+	rowStride(0), planeSize(0), first(nullptr) {
+	if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+		std::cout << "Error: Row alignment has to be a power of two\n";
+		return;
+	}
+	const size_t rowBytes = (size_t)width * bytesPerPixel;
+	rowStride = (stride != 0) ? stride : (rowBytes + alignment - 1) / alignment * alignment;
+	if (rowStride < rowBytes || rowStride % alignment != 0) {
+		std::cout << "Error: Stride " + std::to_string(rowStride) + " does not hold a " + std::to_string(rowBytes) +
+			" byte row aligned to " + std::to_string(alignment) + " bytes\n";
+		rowStride = 0;
+		return;
+	}
+	// The stride is a multiple of the alignment, so aligning the start aligns every row of every plane
+	planeSize = rowStride * height;
+	storage.assign(planeSize * planes() + alignment - 1, 0);
+	const size_t misalignment = (uintptr_t)storage.data() % alignment;
+	first = storage.data() + ((misalignment == 0) ? 0 : alignment - misalignment);
+	if (format == PixelFormat::YCbCrPlanar) {
+		std::fill(first + planeSize, first + 3 * planeSize, neutralChroma);
+	}
+}
+
+bool PixelBuffer::isValid() const {
+	return first != nullptr;
+}
+
+uint PixelBuffer::planes() const {
+	return (format == PixelFormat::YCbCrPlanar) ? 3 : 1;
+}
+
+size_t PixelBuffer::stride() const {
+	return rowStride;
+}
+
+byte* PixelBuffer::plane(uint index) {
+	return first + index * planeSize;
+}
+
+const byte* PixelBuffer::plane(uint index) const {
+	return first + index * planeSize;
+}
+
+void PixelBuffer::writeMCURow(uint mcuRow, const MCU* const rowMCUs) {
+	if (!isValid()) {
+		return;
+	}
+	const uint firstRow = mcuRow * 8;
+	const uint rows = std::min(8u, height - firstRow);
+	for (uint pixelRow = 0; pixelRow < rows; ++pixelRow) {
+		const size_t rowOffset = (firstRow + pixelRow) * rowStride;
+		for (uint c = 0; c * 8 < width; ++c) {
+			const MCU& mcu = rowMCUs[c];
+			const uint columns = std::min(8u, width - c * 8);
+			const int* const samples = &mcu.y[pixelRow * 8];
+			if (format == PixelFormat::YCbCrPlanar) {
+				byte* const y = plane(0) + rowOffset + c * 8;
+				byte* const cb = plane(1) + rowOffset + c * 8;
+				byte* const cr = plane(2) + rowOffset + c * 8;
+				for (uint k = 0; k < columns; ++k) {
+					y[k] = levelShift(samples[k]);
+					cb[k] = levelShift(mcu.cb[pixelRow * 8 + k]);
+					cr[k] = levelShift(mcu.cr[pixelRow * 8 + k]);
+				}
+			}
+			else {
+				byte* out = plane(0) + rowOffset + (size_t)c * 8 * 4;
+				for (uint k = 0; k < columns; ++k, out += 4) {
+					const uint pixelID = pixelRow * 8 + k;
+					out[0] = (byte)mcu.b[pixelID];
+					out[1] = (byte)mcu.g[pixelID];
+					out[2] = (byte)mcu.r[pixelID];
+					out[3] = 255;
+				}
+			}
+		}
+	}
+}
+
+void PixelBuffer::writeMCURow(uint mcuRow, const GrayMCU* const rowMCUs) {
+	if (!isValid()) {
+		return;
+	}
+	const uint firstRow = mcuRow * 8;
+	const uint rows = std::min(8u, height - firstRow);
+	for (uint pixelRow = 0; pixelRow < rows; ++pixelRow) {
+		const size_t rowOffset = (firstRow + pixelRow) * rowStride;
+		for (uint c = 0; c * 8 < width; ++c) {
+			const int* const samples = &rowMCUs[c].y[pixelRow * 8];
+			const uint columns = std::min(8u, width - c * 8);
+			byte* out = plane(0) + rowOffset + (size_t)c * 8 * bytesPerPixel;
+			for (uint k = 0; k < columns; ++k, out += bytesPerPixel) {
+				out[0] = (byte)samples[k];
+				if (format == PixelFormat::BGRA32) {
+					out[1] = (byte)samples[k];
+					out[2] = (byte)samples[k];
+					out[3] = 255;
+				}
+			}
+		}
+	}
+}
+
+bool PixelBuffer::save(const std::string& filename) const {
+	if (!isValid()) {
+		return false;
+	}
+	std::ofstream outFile = std::ofstream(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!outFile.is_open()) {
+		std::cout << "Error: Could not open output file\n";
+		return false;
+	}
+	outFile.write((const char*)first, (std::streamsize)(planeSize * planes()));
+	return (bool)outFile;
+}
+
+std::string pixelFormatExtension(PixelFormat format) {
+	switch (format) {
+	case PixelFormat::BGRA32:
+		return ".bgra";
+	case PixelFormat::YCbCrPlanar:
+		return ".yuv";
+	default:
+		return ".bmp";
+	}
+}
@@ -0,0 +1,138 @@
+#include "../include/resampler.h"
+#include <cmath>
+#include <algorithm>
+
+const double resamplePi = 3.14159265358979323846;
+
+double filterSupport(ResampleFilter filter) {
+	switch (filter) {
+	case ResampleFilter::Box:
+		return 0.5;
+	case ResampleFilter::Bilinear:
+		return 1.0;
+	default:
+		return 3.0;
+	}
+}
+
+double sinc(double x) {
+	if (x == 0.0) {
+		return 1.0;
+	}
+	x *= resamplePi;
+	return std::sin(x) / x;
+}
+
+double filterWeight(ResampleFilter filter, double x) {
+	switch (filter) {
+	case ResampleFilter::Box:
+		return (x >= -0.5 && x < 0.5) ? 1.0 : 0.0;
+	case ResampleFilter::Bilinear:
+		x = std::fabs(x);
+		return (x < 1.0) ? 1.0 - x : 0.0;
+	default:
+		return (x > -3.0 && x < 3.0) ? sinc(x) * sinc(x / 3.0) : 0.0;
+	}
+}
+
+// Downscaling stretches the filter over scale source pixels so every source pixel contributes
+ResampleTaps buildTaps(uint size, uint targetSize, ResampleFilter filter) {
+	ResampleTaps taps;
+	const double scale = (double)size / targetSize;
+	const double filterScale = (scale > 1.0) ? scale : 1.0;
+	const double support = filterSupport(filter) * filterScale;
+	taps.maxTaps = (uint)std::ceil(support) * 2 + 1;
+	taps.first.resize(targetSize);
+	taps.count.resize(targetSize);
+	taps.weights.assign((size_t)targetSize * taps.maxTaps, 0.0f);
+
+	for (uint i = 0; i < targetSize; ++i) {
+		const double center = (i + 0.5) * scale;
+		int first = (int)(center - support + 0.5);
+		int last = (int)(center + support + 0.5);
+		first = (first < 0) ? 0 : first;
+		last = (last > (int)size) ? (int)size : last;
+		if (last - first > (int)taps.maxTaps) {
+			last = first + (int)taps.maxTaps;
+		}
+
+		float* const weights = &taps.weights[(size_t)i * taps.maxTaps];
+		double total = 0.0;
+		for (int k = first; k < last; ++k) {
+			const double weight = filterWeight(filter, (k - center + 0.5) / filterScale);
+			weights[k - first] = (float)weight;
+			total += weight;
+		}
+		if (total != 0.0) {
+			for (int k = 0; k < last - first; ++k) {
+				weights[k] = (float)(weights[k] / total);
+			}
+		}
+		taps.first[i] = (uint)first;
+		taps.count[i] = (uint)(last - first);
+	}
+	return taps;
+}
+
+Resampler::Resampler(uint width, uint height, uint targetWidth, uint targetHeight, uint channels, ResampleFilter filter) :
+	width(width), height(height), targetWidth(targetWidth), targetHeight(targetHeight), channels(channels),
+	horizontal(buildTaps(width, targetWidth, filter)), vertical(buildTaps(height, targetHeight, filter)),
+	ring((size_t)vertical.maxTaps * targetWidth * channels), accumulator((size_t)targetWidth * channels),
+	output((size_t)targetWidth * channels), rowsPushed(0), rowsEmitted(0) {}
+
+// Channel count as a constant so the per tap work unrolls into straight line multiply-adds
+template <uint Channels>
+void filterRowChannels(const ResampleTaps& taps, uint targetWidth, const byte* const row, float* const out) {
+	for (uint i = 0; i < targetWidth; ++i) {
+		const byte* in = row + (size_t)taps.first[i] * Channels;
+		const float* const weights = &taps.weights[(size_t)i * taps.maxTaps];
+		const uint count = taps.count[i];
+		float sums[Channels] = { 0.0f };
+		for (uint k = 0; k < count; ++k, in += Channels) {
+			for (uint c = 0; c < Channels; ++c) {
+				sums[c] += weights[k] * in[c];
+			}
+		}
+		for (uint c = 0; c < Channels; ++c) {
+			out[i * Channels + c] = sums[c];
+		}
+	}
+}
+
+void Resampler::filterRow(const byte* const row, float* const out) const {
+	if (channels == 1) {
+		filterRowChannels<1>(horizontal, targetWidth, row, out);
+	}
+	else {
+		filterRowChannels<3>(horizontal, targetWidth, row, out);
+	}
+}
+
+void Resampler::pushRow(const byte* const row, const RowCallback& emit) {
+	if (rowsPushed >= height) {
+		return;
+	}
+	const size_t rowLength = (size_t)targetWidth * channels;
+	filterRow(row, &ring[(rowsPushed % vertical.maxTaps) * rowLength]);
+	rowsPushed += 1;
+
+	while (rowsEmitted < targetHeight && vertical.first[rowsEmitted] + vertical.count[rowsEmitted] <= rowsPushed) {
+		const float* const weights = &vertical.weights[(size_t)rowsEmitted * vertical.maxTaps];
+		const uint first = vertical.first[rowsEmitted];
+		std::fill(accumulator.begin(), accumulator.end(), 0.0f);
+		// Whole rows at a time, the inner loop runs over contiguous floats
+		for (uint k = 0; k < vertical.count[rowsEmitted]; ++k) {
+			const float weight = weights[k];
+			const float* const source = &ring[((first + k) % vertical.maxTaps) * rowLength];
+			for (size_t i = 0; i < rowLength; ++i) {
+				accumulator[i] += weight * source[i];
+			}
+		}
+		for (size_t i = 0; i < rowLength; ++i) {
+			const float value = accumulator[i] + 0.5f;
+			output[i] = (value <= 0.0f) ? 0 : (value >= 255.0f) ? 255 : (byte)value;
+		}
+		emit(rowsEmitted, output.data());
+		rowsEmitted += 1;
+	}
+}
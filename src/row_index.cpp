@@ -0,0 +1,243 @@
+#include "../include/row_index.h"
+#include "../include/byte_reader.h"
+#include "../include/bit_reader.h"
+#include <iostream>
+#include <fstream>
+#include <memory>
+#include <algorithm>
+
+void parseHeaders(ByteReader&, JPEGImage* const);
+void parseScanData(ByteReader&, JPEGImage* const);
+void generateAllHuffmanCodes(JPEGImage* const);
+bool decodeMCURange(BitReader&, const JPEGImage* const, int* const, MCU* const, uint, uint, const bool);
+void reconstructMCUs(const JPEGImage* const, MCU* const, uint, const uint);
+
+// Sidecar layout, little endian: magic, version, source size, source mtime, header hash, scan offset,
+// MCU rows, MCU columns, then per checkpoint its offset, bit and three DC predictors
+const byte rowIndexMagic[4] = { 'P', 'C', 'R', 'I' };
+const uint rowIndexVersion = 1;
+const size_t rowIndexHeaderSize = 4 + 4 + 8 * 4 + 4 * 2;
+const size_t checkpointSize = 8 + 1 + 4 * 3;
+
+void putLittleEndian(std::vector<byte>& out, uint64 value, uint bytes) {
+	for (uint i = 0; i < bytes; ++i) {
+		out.push_back((byte)(value >> (8 * i)));
+	}
+}
+
+uint64 getLittleEndian(ByteReader& reader, uint bytes) {
+	uint64 value = 0;
+	for (uint i = 0; i < bytes; ++i) {
+		value |= (uint64)(byte)reader.get() << (8 * i);
+	}
+	return value;
+}
+
+// Appends the entropy coded bytes in data to out, removing byte stuffing and restart markers, up to EOI
+void unstuffScanSpan(const std::vector<byte>& data, std::vector<byte>& out) {
+	for (size_t i = 0; i < data.size(); ++i) {
+		if (data[i] != 0xFF) {
+			out.push_back(data[i]);
+			continue;
+		}
+		if (i + 1 >= data.size()) {
+			return;
+		}
+		const byte marker = data[i + 1];
+		if (marker == 0x00) {
+			out.push_back(0xFF);
+			i += 1;
+		}
+		else if (marker >= RST0 && marker <= RST7) {
+			i += 1;
+		}
+		else if (marker != 0xFF) {
+			return;
+		}
+	}
+}
+
+bool RowIndex::build(const std::string& filename) {
+	std::vector<byte> data;
+	if (!readFile(filename, data) || !statFile(filename, sourceSize, sourceModifiedTime)) {
+		std::cout << "Error: Could not open file\n";
+		return false;
+	}
+	std::unique_ptr<JPEGImage> jpeg(new JPEGImage);
+	ByteReader reader(data);
+	parseHeaders(reader, jpeg.get());
+	scanOffset = reader.position();
+	if (jpeg->isValid) {
+		parseScanData(reader, jpeg.get());
+	}
+	if (!jpeg->isValid) {
+		std::cout << "Error: Provided file " + filename + " is an invalid JPEG\n";
+		return false;
+	}
+	headerHash = hashBytes(data.data(), (size_t)scanOffset);
+	mcuRows = (jpeg->height + 7) / 8;
+	mcuColumns = (jpeg->width + 7) / 8;
+	generateAllHuffmanCodes(jpeg.get());
+
+	// Entropy decode only, remembering where each row starts in the unstuffed data
+	BitReader bitReader(jpeg->huffmanData);
+	int prevDCCoefficients[3] = { 0 };
+	std::vector<MCU> row(mcuColumns);
+	std::vector<size_t> rowBits(mcuRows + 1);
+	checkpoints.assign(mcuRows + 1, RowCheckpoint());
+	for (uint i = 0; i < mcuRows; ++i) {
+		rowBits[i] = bitReader.position();
+		std::copy(prevDCCoefficients, prevDCCoefficients + 3, checkpoints[i].prevDCCoefficients);
+		if (!decodeMCURange(bitReader, jpeg.get(), prevDCCoefficients, row.data(), i * mcuColumns, mcuColumns, true)) {
+			return false;
+		}
+	}
+	rowBits[mcuRows] = bitReader.position();
+
+	// Replays the unstuffing over the file to find which file byte each row start came from
+	size_t produced = 0;
+	uint next = 0;
+	size_t i = (size_t)scanOffset;
+	while (true) {
+		while (next <= mcuRows && rowBits[next] / 8 <= produced) {
+			checkpoints[next].offset = i;
+			checkpoints[next].bit = (byte)(rowBits[next] % 8);
+			next += 1;
+		}
+		if (next > mcuRows || i + 1 >= data.size()) {
+			break;
+		}
+		if (data[i] != 0xFF) {
+			produced += 1;
+			i += 1;
+		}
+		else if (data[i + 1] == 0x00) {
+			produced += 1;
+			i += 2;
+		}
+		else if (data[i + 1] == 0xFF) {
+			i += 1;
+		}
+		else if (data[i + 1] >= RST0 && data[i + 1] <= RST7) {
+			i += 2;
+		}
+		else {
+			break;
+		}
+	}
+	if (next <= mcuRows) {
+		std::cout << "Error: Scan data of " + filename + " ends before its last row\n";
+		return false;
+	}
+	return true;
+}
+
+bool RowIndex::load(const std::string& path, const std::string& filename) {
+	std::vector<byte> data;
+	uint64 size = 0;
+	uint64 modifiedTime = 0;
+	if (!readFile(path, data) || data.size() < rowIndexHeaderSize || !std::equal(rowIndexMagic, rowIndexMagic + 4, data.begin()) ||
+		!statFile(filename, size, modifiedTime)) {
+		return false;
+	}
+	ByteReader reader(data);
+	getLittleEndian(reader, 4);
+	if (getLittleEndian(reader, 4) != rowIndexVersion) {
+		return false;
+	}
+	sourceSize = getLittleEndian(reader, 8);
+	sourceModifiedTime = getLittleEndian(reader, 8);
+	headerHash = getLittleEndian(reader, 8);
+	scanOffset = getLittleEndian(reader, 8);
+	mcuRows = (uint)getLittleEndian(reader, 4);
+	mcuColumns = (uint)getLittleEndian(reader, 4);
+	if (sourceSize != size || sourceModifiedTime != modifiedTime || data.size() != rowIndexHeaderSize + ((size_t)mcuRows + 1) * checkpointSize) {
+		return false;
+	}
+	checkpoints.assign(mcuRows + 1, RowCheckpoint());
+	for (RowCheckpoint& checkpoint : checkpoints) {
+		checkpoint.offset = getLittleEndian(reader, 8);
+		checkpoint.bit = (byte)getLittleEndian(reader, 1);
+		for (uint j = 0; j < 3; ++j) {
+			checkpoint.prevDCCoefficients[j] = (int)(unsigned int)getLittleEndian(reader, 4);
+		}
+	}
+	return true;
+}
+
+bool RowIndex::save(const std::string& path) const {
+	std::vector<byte> data(rowIndexMagic, rowIndexMagic + 4);
+	putLittleEndian(data, rowIndexVersion, 4);
+	putLittleEndian(data, sourceSize, 8);
+	putLittleEndian(data, sourceModifiedTime, 8);
+	putLittleEndian(data, headerHash, 8);
+	putLittleEndian(data, scanOffset, 8);
+	putLittleEndian(data, mcuRows, 4);
+	putLittleEndian(data, mcuColumns, 4);
+	for (const RowCheckpoint& checkpoint : checkpoints) {
+		putLittleEndian(data, checkpoint.offset, 8);
+		putLittleEndian(data, checkpoint.bit, 1);
+		for (uint j = 0; j < 3; ++j) {
+			putLittleEndian(data, (unsigned int)checkpoint.prevDCCoefficients[j], 4);
+		}
+	}
+	std::ofstream outFile = std::ofstream(path, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!outFile.is_open()) {
+		return false;
+	}
+	outFile.write((const char*)data.data(), (std::streamsize)data.size());
+	return (bool)outFile;
+}
+
+uint RowIndex::rows() const {
+	return mcuRows;
+}
+
+bool RowIndex::decodeRows(const std::string& filename, uint firstRow, uint count, const HeaderCallback& onHeader, const RowCallback& onRow) const {
+	if (firstRow >= mcuRows || count == 0) {
+		std::cout << "Error: Rows outside of the image\n";
+		return false;
+	}
+	count = std::min(count, mcuRows - firstRow);
+
+	// The headers are read again, their hash also catches edits that kept the size and modification time
+	std::vector<byte> headers;
+	if (!readFileRange(filename, 0, scanOffset, headers) || headers.size() != scanOffset || hashBytes(headers.data(), headers.size()) != headerHash) {
+		std::cout << "Error: Row index of " + filename + " is out of date\n";
+		return false;
+	}
+	std::unique_ptr<JPEGImage> jpeg(new JPEGImage);
+	ByteReader reader(headers);
+	parseHeaders(reader, jpeg.get());
+	if (!jpeg->isValid || (jpeg->height + 7) / 8 != mcuRows || (jpeg->width + 7) / 8 != mcuColumns) {
+		std::cout << "Error: Row index of " + filename + " is out of date\n";
+		return false;
+	}
+
+	// The last row may end inside the byte the next checkpoint starts in, which can be a stuffed 0xFF
+	const RowCheckpoint& start = checkpoints[firstRow];
+	const RowCheckpoint& end = checkpoints[firstRow + count];
+	std::vector<byte> span;
+	if (!readFileRange(filename, start.offset, end.offset + 2 - start.offset, span)) {
+		std::cout << "Error: Could not open file\n";
+		return false;
+	}
+	unstuffScanSpan(span, jpeg->huffmanData);
+	generateAllHuffmanCodes(jpeg.get());
+	if (!onHeader(jpeg.get())) {
+		return false;
+	}
+
+	BitReader bitReader(jpeg->huffmanData);
+	bitReader.seek(start.bit);
+	int prevDCCoefficients[3] = { start.prevDCCoefficients[0], start.prevDCCoefficients[1], start.prevDCCoefficients[2] };
+	std::vector<MCU> row(mcuColumns);
+	for (uint i = firstRow; i < firstRow + count; ++i) {
+		if (!decodeMCURange(bitReader, jpeg.get(), prevDCCoefficients, row.data(), i * mcuColumns, mcuColumns, true)) {
+			return false;
+		}
+		reconstructMCUs(jpeg.get(), row.data(), mcuColumns, 8);
+		onRow(i, row.data());
+	}
+	return true;
+}
@@ -0,0 +1,116 @@
+#include "../include/tile_pyramid.h"
+#include "../include/bitmap_encoder.h"
+#include "../include/file_io.h"
+#include <iostream>
+#include <algorithm>
+
+TilePyramid::TilePyramid(const std::string& directory, uint width, uint height, uint channels, uint tileSize) :
+	directory(directory), channels(channels), tileSize(tileSize), row((size_t)width * channels), tileCount(0), hasFailed(false) {
+	while (true) {
+		Level level;
+		level.width = width;
+		level.height = height;
+		level.band.resize((size_t)tileSize * width * channels);
+		pyramid.push_back(level);
+		if (!makeDirectory(directory + "/" + std::to_string(pyramid.size() - 1))) {
+			std::cout << "Error: Could not create directory " + directory + "/" + std::to_string(pyramid.size() - 1) + "\n";
+			hasFailed = true;
+		}
+		if (width <= tileSize && height <= tileSize) {
+			break;
+		}
+		pyramid.back().pending.resize((size_t)width * channels);
+		width = (width + 1) / 2;
+		height = (height + 1) / 2;
+		pyramid.back().reduced.resize((size_t)width * channels);
+	}
+}
+
+uint TilePyramid::levels() const {
+	return (uint)pyramid.size();
+}
+
+uint TilePyramid::tilesWritten() const {
+	return tileCount;
+}
+
+bool TilePyramid::failed() const {
+	return hasFailed;
+}
+
+void TilePyramid::writeMCURow(uint mcuRow, const MCU* const rowMCUs) {
+	const uint width = pyramid[0].width;
+	for (uint y = mcuRow * 8; y < mcuRow * 8 + 8 && y < pyramid[0].height; ++y) {
+		const uint rowOffset = (y - mcuRow * 8) * 8;
+		for (uint x = 0; x < width; ++x) {
+			const MCU& mcu = rowMCUs[x / 8];
+			const uint pixelID = rowOffset + x % 8;
+			if (channels == 1) {
+				row[x] = mcu.y[pixelID];
+			}
+			else {
+				row[x * 3] = mcu.r[pixelID];
+				row[x * 3 + 1] = mcu.g[pixelID];
+				row[x * 3 + 2] = mcu.b[pixelID];
+			}
+		}
+		pushRow(0, row.data());
+	}
+}
+
+void TilePyramid::pushRow(const byte* const pixels) {
+	pushRow(0, pixels);
+}
+
+void TilePyramid::pushRow(uint level, const byte* const pixels) {
+	Level& current = pyramid[level];
+	const size_t rowBytes = (size_t)current.width * channels;
+	const uint y = current.rowsReceived;
+	std::copy(pixels, pixels + rowBytes, current.band.begin() + (size_t)(y % tileSize) * rowBytes);
+	current.rowsReceived += 1;
+	if (current.rowsReceived % tileSize == 0 || current.rowsReceived == current.height) {
+		writeTiles(level, y / tileSize, y % tileSize + 1);
+	}
+	if (level + 1 == pyramid.size()) {
+		return;
+	}
+
+	// Pairs of rows go down a level, an odd last row is paired with itself
+	const bool last = current.rowsReceived == current.height;
+	if (!current.hasPending && !last) {
+		std::copy(pixels, pixels + rowBytes, current.pending.begin());
+		current.hasPending = true;
+		return;
+	}
+	const byte* const top = current.hasPending ? current.pending.data() : pixels;
+	current.hasPending = false;
+	std::vector<byte>& reduced = current.reduced;
+	const uint reducedWidth = pyramid[level + 1].width;
+	for (uint x = 0; x < reducedWidth; ++x) {
+		// An odd last column is paired with itself as well
+		const uint left = 2 * x * channels;
+		const uint right = (2 * x + 1 < current.width) ? left + channels : left;
+		for (uint c = 0; c < channels; ++c) {
+			reduced[x * channels + c] = (byte)((top[left + c] + top[right + c] + pixels[left + c] + pixels[right + c] + 2) / 4);
+		}
+	}
+	pushRow(level + 1, reduced.data());
+}
+
+void TilePyramid::writeTiles(uint level, uint tileRow, uint rows) {
+	const Level& current = pyramid[level];
+	const size_t rowBytes = (size_t)current.width * channels;
+	for (uint column = 0; column * tileSize < current.width; ++column) {
+		const uint tileWidth = std::min(tileSize, current.width - column * tileSize);
+		const std::string name = directory + "/" + std::to_string(level) + "/" + std::to_string(column) + "_" + std::to_string(tileRow) + ".bmp";
+		BitmapRowWriter writer(name, tileWidth, rows, channels * 8);
+		if (!writer.isOpen()) {
+			hasFailed = true;
+			continue;
+		}
+		for (uint y = 0; y < rows; ++y) {
+			writer.writeRow(y, &current.band[y * rowBytes + (size_t)column * tileSize * channels]);
+		}
+		tileCount += 1;
+	}
+}
@@ -0,0 +1,88 @@
+#include "../../include/batch_manifest.h"
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+
+// One line per input: input, size, mtime, hash, options key, output, output size, separated by tabs
+const std::string manifestHeader = "# picat manifest v1";
+
+BatchManifest::BatchManifest(const std::string& path) :
+	path(path) {}
+
+bool BatchManifest::load() {
+	std::ifstream inFile = std::ifstream(path, std::ios::in);
+	if (!inFile.is_open()) {
+		return false;
+	}
+	std::string line;
+	if (!std::getline(inFile, line) || line != manifestHeader) {
+		return false;
+	}
+	while (std::getline(inFile, line)) {
+		std::istringstream fields(line);
+		std::string input;
+		std::string number;
+		ManifestEntry entry;
+		if (!std::getline(fields, input, '\t')) {
+			continue;
+		}
+		std::getline(fields, number, '\t');
+		entry.size = std::strtoull(number.c_str(), nullptr, 10);
+		std::getline(fields, number, '\t');
+		entry.modifiedTime = std::strtoull(number.c_str(), nullptr, 10);
+		std::getline(fields, number, '\t');
+		entry.hash = std::strtoull(number.c_str(), nullptr, 16);
+		std::getline(fields, entry.optionsKey, '\t');
+		std::getline(fields, entry.output, '\t');
+		if (!std::getline(fields, number, '\t')) {
+			continue;
+		}
+		entry.outputSize = std::strtoull(number.c_str(), nullptr, 10);
+		entries[input] = entry;
+	}
+	return true;
+}
+
+bool BatchManifest::save() const {
+	// Write next to the manifest and rename, so an interrupted run never leaves a truncated manifest behind
+	const std::string temporaryPath = path + ".tmp";
+	{
+		std::ofstream outFile = std::ofstream(temporaryPath, std::ios::out | std::ios::trunc);
+		if (!outFile.is_open()) {
+			return false;
+		}
+		outFile << manifestHeader << "\n";
+		for (const std::pair<const std::string, ManifestEntry>& item : entries) {
+			const ManifestEntry& entry = item.second;
+			outFile << item.first << "\t" << entry.size << "\t" << entry.modifiedTime << "\t"
+				<< std::hex << entry.hash << std::dec << "\t" << entry.optionsKey << "\t"
+				<< entry.output << "\t" << entry.outputSize << "\n";
+		}
+		if (!outFile) {
+			return false;
+		}
+	}
+	std::remove(path.c_str());
+	return std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+}
+
+bool BatchManifest::isUpToDate(const std::string& input, const ManifestEntry& current, bool byContent) const {
+	const std::map<std::string, ManifestEntry>::const_iterator found = entries.find(input);
+	if (found == entries.end()) {
+		return false;
+	}
+	const ManifestEntry& entry = found->second;
+	if (entry.optionsKey != current.optionsKey || entry.size != current.size) {
+		return false;
+	}
+	if (byContent ? (entry.hash == 0 || entry.hash != current.hash) : (entry.modifiedTime != current.modifiedTime)) {
+		return false;
+	}
+	uint64 outputSize = 0;
+	uint64 outputModifiedTime = 0;
+	return statFile(entry.output, outputSize, outputModifiedTime) && outputSize == entry.outputSize;
+}
+
+void BatchManifest::record(const std::string& input, const ManifestEntry& entry) {
+	entries[input] = entry;
+}
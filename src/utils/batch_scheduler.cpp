@@ -0,0 +1,84 @@
+#include "../../include/batch_scheduler.h"
+#include <thread>
+#include <algorithm>
+
+BatchScheduler::BatchScheduler(uint64 budget, uint slots, uint maxBypass) :
+	budget(budget), slots(std::max(slots, 1u)), maxBypass(maxBypass), head(0), headBypassed(0), admitted(0), running(0),
+	peak(0), peakRunning(0) {}
+
+void BatchScheduler::run(const std::vector<uint64>& costs, const std::function<void(size_t)>& job) {
+	started.assign(costs.size(), false);
+	head = 0;
+	headBypassed = 0;
+	admitted = 0;
+	running = 0;
+	// The calling thread is one of the slots
+	std::vector<std::thread> workers;
+	const uint threads = (uint)std::min<size_t>(slots, costs.size());
+	for (uint i = 1; i < threads; ++i) {
+		workers.emplace_back(&BatchScheduler::worker, this, std::cref(costs), std::cref(job));
+	}
+	worker(costs, job);
+	for (std::thread& thread : workers) {
+		thread.join();
+	}
+}
+
+uint64 BatchScheduler::peakAdmitted() const {
+	return peak;
+}
+
+uint BatchScheduler::maxConcurrency() const {
+	return peakRunning;
+}
+
+// Picks the next job to start, with the mutex held. Returns false when none may start yet.
+bool BatchScheduler::admit(const std::vector<uint64>& costs, size_t& index) {
+	while (head < costs.size() && started[head]) {
+		head += 1;
+		headBypassed = 0;
+	}
+	if (head == costs.size()) {
+		return false;
+	}
+	if (running == 0 || admitted + costs[head] <= budget) {
+		index = head;
+		return true;
+	}
+	if (headBypassed >= maxBypass) {
+		return false;
+	}
+	for (size_t i = head + 1; i < costs.size(); ++i) {
+		if (!started[i] && admitted + costs[i] <= budget) {
+			headBypassed += 1;
+			index = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+void BatchScheduler::worker(const std::vector<uint64>& costs, const std::function<void(size_t)>& job) {
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		size_t index = 0;
+		// admit moves head past started jobs, so it has to run before the check for the end
+		finished.wait(lock, [this, &costs, &index]() { return admit(costs, index) || head == costs.size(); });
+		if (head == costs.size()) {
+			return;
+		}
+		started[index] = true;
+		admitted += costs[index];
+		running += 1;
+		peak = std::max(peak, admitted);
+		peakRunning = std::max(peakRunning, running);
+		lock.unlock();
+
+		job(index);
+
+		lock.lock();
+		admitted -= costs[index];
+		running -= 1;
+		finished.notify_all();
+	}
+}
@@ -37,4 +37,29 @@ void BitReader::align() {
 		bitIndex = 0;
 		byteIndex += 1;
 	}
+}
+
+uint BitReader::peekBits(const uint length) const {
+	uint window = 0;
+	for (size_t i = byteIndex; i < byteIndex + 3; ++i) {
+		window = (window << 8) | ((i < data.size()) ? data[i] : 0);
+	}
+	return (window >> (24 - bitIndex - length)) & ((1u << length) - 1);
+}
+
+void BitReader::skipBits(const uint length) {
+	seek(position() + length);
+}
+
+size_t BitReader::position() const {
+	return byteIndex * 8 + bitIndex;
+}
+
+void BitReader::seek(size_t bitPosition) {
+	byteIndex = bitPosition / 8;
+	bitIndex = bitPosition % 8;
+}
+
+size_t BitReader::size() const {
+	return data.size() * 8;
 }
\ No newline at end of file
@@ -0,0 +1,33 @@
+#include "../../include/bit_writer.h"
+BitWriter::BitWriter(std::vector<byte>& data) :
+	data(data), buffer(0), bufferLength(0) {}
+
+void BitWriter::writeBits(const uint bits, const uint length) {
+	// length is at most 16, so at most 23 bits are ever pending in the buffer
+	buffer = (buffer << length) | (bits & ((1u << length) - 1));
+	bufferLength += length;
+	while (bufferLength >= 8) {
+		bufferLength -= 8;
+		putByte((buffer >> bufferLength) & 0xFF);
+	}
+	buffer &= (1u << bufferLength) - 1;
+}
+
+void BitWriter::flush() {
+	if (bufferLength != 0) {
+		writeBits(0xFF, 8 - bufferLength);
+	}
+}
+
+void BitWriter::writeMarker(const byte marker) {
+	flush();
+	data.push_back(0xFF);
+	data.push_back(marker);
+}
+
+void BitWriter::putByte(const byte value) {
+	data.push_back(value);
+	if (value == 0xFF) {
+		data.push_back(0x00);
+	}
+}
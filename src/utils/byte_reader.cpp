@@ -0,0 +1,24 @@
+#include "../../include/byte_reader.h"
+ByteReader::ByteReader(const std::vector<byte>& data) :
+	data(data), index(0), failed(false) {}
+
+int ByteReader::get() {
+	if (index >= data.size()) {
+		failed = true;
+		return -1;
+	}
+	return data[index++];
+}
+
+bool ByteReader::operator!() const {
+	return failed;
+}
+
+size_t ByteReader::position() const {
+	return index;
+}
+
+void ByteReader::seek(size_t position) {
+	index = position;
+	failed = false;
+}
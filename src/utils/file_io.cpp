@@ -0,0 +1,89 @@
+#include "../../include/file_io.h"
+#include <fstream>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <cerrno>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+const size_t readChunkSize = 64 * 1024;
+const uint64 fnvPrime = 1099511628211ULL;
+
+uint64 hashBytes(const byte* const data, size_t length, uint64 hash) {
+	for (size_t i = 0; i < length; ++i) {
+		hash = (hash ^ data[i]) * fnvPrime;
+	}
+	return hash;
+}
+
+bool readFileChunked(const std::string& filename, std::vector<byte>& data, uint64* const hash) {
+	std::ifstream inFile = std::ifstream(filename, std::ios::in | std::ios::binary);
+	if (!inFile.is_open()) {
+		return false;
+	}
+	inFile.seekg(0, std::ios::end);
+	const std::streamoff size = inFile.tellg();
+	inFile.seekg(0, std::ios::beg);
+	data.resize((size > 0) ? (size_t)size : 0);
+
+	uint64 h = fnvOffsetBasis;
+	size_t offset = 0;
+	while (offset < data.size()) {
+		const size_t length = (data.size() - offset < readChunkSize) ? (data.size() - offset) : readChunkSize;
+		inFile.read((char*)&data[offset], (std::streamsize)length);
+		const size_t received = (size_t)inFile.gcount();
+		if (hash != nullptr) {
+			// Hash the chunk while it is still hot in cache
+			h = hashBytes(&data[offset], received, h);
+		}
+		offset += received;
+		if (received != length) {
+			data.resize(offset);
+			break;
+		}
+	}
+	if (hash != nullptr) {
+		*hash = h;
+	}
+	return true;
+}
+
+bool readFile(const std::string& filename, std::vector<byte>& data) {
+	return readFileChunked(filename, data, nullptr);
+}
+
+bool readFileHashed(const std::string& filename, std::vector<byte>& data, uint64& hash) {
+	return readFileChunked(filename, data, &hash);
+}
+
+bool readFileRange(const std::string& filename, uint64 offset, uint64 length, std::vector<byte>& data) {
+	std::ifstream inFile = std::ifstream(filename, std::ios::in | std::ios::binary);
+	if (!inFile.is_open()) {
+		return false;
+	}
+	inFile.seekg((std::streamoff)offset, std::ios::beg);
+	data.resize((size_t)length);
+	inFile.read((char*)data.data(), (std::streamsize)length);
+	data.resize((size_t)inFile.gcount());
+	return true;
+}
+
+bool statFile(const std::string& filename, uint64& size, uint64& modifiedTime) {
+	struct stat info;
+	if (stat(filename.c_str(), &info) != 0) {
+		return false;
+	}
+	size = (uint64)info.st_size;
+	modifiedTime = (uint64)info.st_mtime;
+	return true;
+}
+
+bool makeDirectory(const std::string& path) {
+#ifdef _WIN32
+	const int result = _mkdir(path.c_str());
+#else
+	const int result = mkdir(path.c_str(), 0755);
+#endif
+	return result == 0 || errno == EEXIST;
+}
@@ -0,0 +1,65 @@
+#include "../../include/huffman_cache.h"
+#include "../../include/file_io.h"
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+// Distinct tables seen in practice are the Annex K set plus a handful per encoder, the cap only guards against hostile batches
+const size_t maxCachedHuffmanTables = 1024;
+
+uint64 hashHuffmanTable(const HuffmanTable& table) {
+	return hashBytes(table.symbols, table.offsets[16], hashBytes(table.offsets, sizeof(table.offsets), fnvOffsetBasis));
+}
+
+bool sameHuffmanTable(const HuffmanLookup& lookup, const HuffmanTable& table) {
+	return std::memcmp(lookup.offsets, table.offsets, sizeof(lookup.offsets)) == 0 &&
+		std::memcmp(lookup.symbols, table.symbols, table.offsets[16]) == 0;
+}
+
+std::shared_ptr<const HuffmanLookup> buildHuffmanLookup(const HuffmanTable& table) {
+	std::shared_ptr<HuffmanLookup> lookup = std::make_shared<HuffmanLookup>();
+	std::memcpy(lookup->offsets, table.offsets, sizeof(lookup->offsets));
+	std::memcpy(lookup->symbols, table.symbols, table.offsets[16]);
+
+	uint code = 0;
+	for (uint i = 0; i < 16; ++i) {
+		const uint length = i + 1;
+		for (uint j = table.offsets[i]; j < table.offsets[i + 1]; ++j) {
+			lookup->codes[j] = code;
+			// Every lookahead window starting with this code resolves to it
+			if (length <= huffmanLookaheadBits) {
+				const uint shift = huffmanLookaheadBits - length;
+				const uint first = code << shift;
+				for (uint k = 0; k < (1u << shift); ++k) {
+					lookup->lookaheadSymbols[first + k] = table.symbols[j];
+					lookup->lookaheadLengths[first + k] = (byte)length;
+				}
+			}
+			code += 1;
+		}
+		code <<= 1;
+	}
+	return lookup;
+}
+
+std::shared_ptr<const HuffmanLookup> acquireHuffmanLookup(const HuffmanTable& table) {
+	static std::mutex cacheMutex;
+	static std::unordered_map<uint64, std::shared_ptr<const HuffmanLookup>> cache;
+
+	const uint64 hash = hashHuffmanTable(table);
+	{
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		const auto found = cache.find(hash);
+		if (found != cache.end() && sameHuffmanTable(*found->second, table)) {
+			return found->second;
+		}
+	}
+
+	// Build outside the lock, two threads racing on a new table just build it twice
+	std::shared_ptr<const HuffmanLookup> lookup = buildHuffmanLookup(table);
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	if (cache.size() < maxCachedHuffmanTables) {
+		cache.emplace(hash, lookup);
+	}
+	return lookup;
+}
@@ -0,0 +1,311 @@
+#include "../../include/read_ahead.h"
+#include <cstring>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#if defined(__linux__) && defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define READ_AHEAD_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#ifdef READ_AHEAD_IO_URING
+
+// Submission and completion rings mapped from the kernel, driven through raw syscalls so no liburing is needed
+struct IoUringQueue {
+	int fd = -1;
+	void* sqRing = MAP_FAILED;
+	size_t sqRingSize = 0;
+	void* cqRing = MAP_FAILED;
+	size_t cqRingSize = 0;
+	io_uring_sqe* sqes = (io_uring_sqe*)MAP_FAILED;
+	size_t sqesSize = 0;
+
+	unsigned* sqTail = nullptr;
+	unsigned* sqMask = nullptr;
+	unsigned* sqArray = nullptr;
+	unsigned* cqHead = nullptr;
+	unsigned* cqTail = nullptr;
+	unsigned* cqMask = nullptr;
+	io_uring_cqe* cqes = nullptr;
+
+	// One iovec per submission slot, READV reads them when the entry is submitted
+	std::vector<iovec> vectors;
+};
+
+void closeIoUring(IoUringQueue* const queue) {
+	if (queue->sqes != MAP_FAILED) {
+		munmap(queue->sqes, queue->sqesSize);
+	}
+	if (queue->cqRing != MAP_FAILED && queue->cqRing != queue->sqRing) {
+		munmap(queue->cqRing, queue->cqRingSize);
+	}
+	if (queue->sqRing != MAP_FAILED) {
+		munmap(queue->sqRing, queue->sqRingSize);
+	}
+	if (queue->fd >= 0) {
+		close(queue->fd);
+	}
+	delete queue;
+}
+
+// Returns nullptr when io_uring is unavailable, e.g. an old kernel or a seccomp filter
+IoUringQueue* openIoUring(uint entries) {
+	io_uring_params params;
+	std::memset(&params, 0, sizeof(params));
+	IoUringQueue* queue = new IoUringQueue();
+	queue->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+	if (queue->fd < 0) {
+		closeIoUring(queue);
+		return nullptr;
+	}
+
+	queue->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	queue->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	const bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (singleMap) {
+		queue->sqRingSize = (queue->sqRingSize > queue->cqRingSize) ? queue->sqRingSize : queue->cqRingSize;
+	}
+	queue->sqRing = mmap(nullptr, queue->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, queue->fd, IORING_OFF_SQ_RING);
+	if (queue->sqRing == MAP_FAILED) {
+		closeIoUring(queue);
+		return nullptr;
+	}
+	queue->cqRing = singleMap ? queue->sqRing :
+		mmap(nullptr, queue->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, queue->fd, IORING_OFF_CQ_RING);
+	queue->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+	queue->sqes = (io_uring_sqe*)mmap(nullptr, queue->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, queue->fd, IORING_OFF_SQES);
+	if (queue->cqRing == MAP_FAILED || queue->sqes == MAP_FAILED) {
+		closeIoUring(queue);
+		return nullptr;
+	}
+
+	byte* const sq = (byte*)queue->sqRing;
+	byte* const cq = (byte*)queue->cqRing;
+	queue->sqTail = (unsigned*)(sq + params.sq_off.tail);
+	queue->sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+	queue->sqArray = (unsigned*)(sq + params.sq_off.array);
+	queue->cqHead = (unsigned*)(cq + params.cq_off.head);
+	queue->cqTail = (unsigned*)(cq + params.cq_off.tail);
+	queue->cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+	queue->cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+	queue->vectors.resize(params.sq_entries);
+	return queue;
+}
+
+int enterIoUring(IoUringQueue* const queue, uint submit, uint waitFor) {
+	while (true) {
+		const int result = (int)syscall(__NR_io_uring_enter, queue->fd, submit, waitFor, waitFor ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+		if (result >= 0 || errno != EINTR) {
+			return result;
+		}
+	}
+}
+
+#else
+
+struct IoUringQueue {};
+
+void closeIoUring(IoUringQueue* const queue) {
+	delete queue;
+}
+
+IoUringQueue* openIoUring(uint) {
+	return nullptr;
+}
+
+#endif
+
+ReadAhead::ReadAhead(const std::vector<std::string>& files, uint depth, uint64 memoryCap, bool hashContent) :
+	requests(files.size()), depth(depth), memoryCap(memoryCap), hashContent(hashContent),
+	nextIndex(0), issuedIndex(0), outstandingBytes(0), ring(nullptr) {
+	for (size_t i = 0; i < files.size(); ++i) {
+		requests[i].filename = files[i];
+	}
+	if (depth == 0 || files.empty()) {
+		return;
+	}
+	ring = openIoUring(depth);
+	if (ring == nullptr) {
+		// One reader thread per read in flight, the calling thread keeps decoding
+		readers.reset(new ThreadPool(depth + 1, 0));
+	}
+	issue();
+}
+
+ReadAhead::~ReadAhead() {
+	// Buffers must outlive every read the kernel or a reader thread still holds
+	readers.reset();
+	if (ring != nullptr) {
+		for (size_t i = nextIndex; i < issuedIndex; ++i) {
+			waitFor(requests[i]);
+		}
+		closeIoUring(ring);
+	}
+}
+
+bool ReadAhead::usingIoUring() const {
+	return ring != nullptr;
+}
+
+bool ReadAhead::next(std::string& filename, std::vector<byte>& data, uint64& hash, bool& ok) {
+	if (nextIndex >= requests.size()) {
+		return false;
+	}
+	Request& request = requests[nextIndex];
+	if (depth == 0) {
+		readRequest(request);
+	}
+	else {
+		issue();
+		waitFor(request);
+	}
+
+	filename = request.filename;
+	data.swap(request.data);
+	std::vector<byte>().swap(request.data);
+	hash = request.hash;
+	ok = request.ok;
+	if (depth != 0) {
+		outstandingBytes -= request.size;
+	}
+	nextIndex += 1;
+	if (depth != 0) {
+		issue();
+	}
+	return true;
+}
+
+// Issues reads in file order while fewer than depth are outstanding and their sizes fit under the memory cap.
+// The next file the caller needs is always issued, however large it is.
+void ReadAhead::issue() {
+	while (issuedIndex < requests.size() && issuedIndex - nextIndex < depth) {
+		Request& request = requests[issuedIndex];
+		uint64 modifiedTime = 0;
+		if (!statFile(request.filename, request.size, modifiedTime)) {
+			request.size = 0;
+		}
+		if (issuedIndex != nextIndex && outstandingBytes + request.size > memoryCap) {
+			return;
+		}
+		outstandingBytes += request.size;
+		issueRequest(request, issuedIndex);
+		issuedIndex += 1;
+	}
+}
+
+void ReadAhead::issueRequest(Request& request, size_t index) {
+	if (ring == nullptr) {
+		readers->submit([this, &request]() {
+			readRequest(request);
+			std::lock_guard<std::mutex> lock(mutex);
+			request.done = true;
+			readDone.notify_all();
+		});
+		return;
+	}
+#ifdef READ_AHEAD_IO_URING
+	request.fd = open(request.filename.c_str(), O_RDONLY | O_CLOEXEC);
+	if (request.fd < 0) {
+		request.done = true;
+		return;
+	}
+	request.data.resize((size_t)request.size);
+	if (request.size == 0 || !submitRingRead(request, index)) {
+		close(request.fd);
+		request.fd = -1;
+		request.ok = request.size == 0;
+		request.done = true;
+	}
+#else
+	(void)index;
+#endif
+}
+
+void ReadAhead::readRequest(Request& request) {
+	request.ok = hashContent ? readFileHashed(request.filename, request.data, request.hash) : readFile(request.filename, request.data);
+}
+
+void ReadAhead::waitFor(Request& request) {
+	if (ring != nullptr) {
+		while (!request.done) {
+			reapRingCompletion();
+		}
+		if (request.ok && hashContent) {
+			request.hash = hashBytes(request.data.data(), request.data.size());
+		}
+		return;
+	}
+	std::unique_lock<std::mutex> lock(mutex);
+	readDone.wait(lock, [&request]() { return request.done; });
+}
+
+#ifdef READ_AHEAD_IO_URING
+
+bool ReadAhead::submitRingRead(Request& request, size_t index) {
+	const unsigned tail = *ring->sqTail;
+	const unsigned slot = tail & *ring->sqMask;
+	iovec& vector = ring->vectors[slot];
+	vector.iov_base = request.data.data() + request.offset;
+	vector.iov_len = (size_t)(request.size - request.offset);
+
+	io_uring_sqe& sqe = ring->sqes[slot];
+	std::memset(&sqe, 0, sizeof(sqe));
+	sqe.opcode = IORING_OP_READV;
+	sqe.fd = request.fd;
+	sqe.addr = (unsigned long long)&vector;
+	sqe.len = 1;
+	sqe.off = request.offset;
+	sqe.user_data = index;
+	ring->sqArray[slot] = slot;
+	__atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+	return enterIoUring(ring, 1, 0) == 1;
+}
+
+void ReadAhead::reapRingCompletion() {
+	const unsigned head = *ring->cqHead;
+	if (head == __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE)) {
+		if (enterIoUring(ring, 0, 1) < 0) {
+			// Without completions the outstanding reads can't be trusted, fail them rather than spin
+			for (size_t i = nextIndex; i < issuedIndex; ++i) {
+				requests[i].done = true;
+			}
+		}
+		return;
+	}
+	const io_uring_cqe cqe = ring->cqes[head & *ring->cqMask];
+	__atomic_store_n(ring->cqHead, head + 1, __ATOMIC_RELEASE);
+
+	Request& request = requests[(size_t)cqe.user_data];
+	request.ok = cqe.res >= 0;
+	if (cqe.res > 0) {
+		request.offset += (uint64)cqe.res;
+		// Short reads continue where they stopped
+		if (request.offset < request.size) {
+			if (submitRingRead(request, (size_t)cqe.user_data)) {
+				return;
+			}
+			request.ok = false;
+		}
+	}
+	// A file that shrank since it was stat'ed ends at the last byte read
+	request.data.resize((size_t)request.offset);
+	request.done = true;
+	close(request.fd);
+	request.fd = -1;
+}
+
+#else
+
+bool ReadAhead::submitRingRead(Request&, size_t) {
+	return false;
+}
+
+void ReadAhead::reapRingCompletion() {}
+
+#endif
@@ -0,0 +1,120 @@
+#include "../../include/thread_pool.h"
+
+ThreadPool::ThreadPool(uint threadCount, uint serialThreshold) :
+	stopping(false), serialThreshold(serialThreshold) {
+	if (threadCount == 0) {
+		threadCount = std::thread::hardware_concurrency();
+	}
+	// The calling thread always takes a share of the work, so it counts as one of the threads
+	for (uint i = 1; i < threadCount; ++i) {
+		workers.emplace_back(&ThreadPool::workerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	taskAvailable.notify_all();
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::submit(const std::function<void()>& task) {
+	if (workers.empty()) {
+		task();
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		tasks.push(task);
+	}
+	taskAvailable.notify_all();
+}
+
+void ThreadPool::parallelFor(uint count, const std::function<void(uint, uint)>& task) {
+	const uint chunks = (count < size()) ? count : size();
+	if (workers.empty() || count < serialThreshold || chunks <= 1) {
+		task(0, count);
+		return;
+	}
+	runTasks(chunks, [&task, count, chunks](uint chunk) {
+		const uint begin = (uint)((unsigned long long)count * chunk / chunks);
+		const uint end = (uint)((unsigned long long)count * (chunk + 1) / chunks);
+		task(begin, end);
+	});
+}
+
+void ThreadPool::forEachIndex(uint count, const std::function<void(uint)>& task) {
+	if (workers.empty() || count <= 1) {
+		for (uint i = 0; i < count; ++i) {
+			task(i);
+		}
+		return;
+	}
+	runTasks(count, task);
+}
+
+void ThreadPool::runTasks(uint count, const std::function<void(uint)>& task) {
+	uint remaining = count - 1;
+	for (uint i = 1; i < count; ++i) {
+		submit([this, &task, &remaining, i]() {
+			task(i);
+			std::lock_guard<std::mutex> lock(mutex);
+			remaining -= 1;
+			taskAvailable.notify_all();
+		});
+	}
+	task(0);
+
+	// Help with queued work while waiting, so a parallelFor issued from inside a worker can't deadlock the pool
+	while (true) {
+		if (runPendingTask()) {
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(mutex);
+		if (remaining == 0) {
+			return;
+		}
+		taskAvailable.wait(lock, [this, &remaining]() { return remaining == 0 || !tasks.empty(); });
+		if (remaining == 0) {
+			return;
+		}
+	}
+}
+
+uint ThreadPool::size() const {
+	return (uint)workers.size() + 1;
+}
+
+bool ThreadPool::runPendingTask() {
+	std::function<void()> task;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (tasks.empty()) {
+			return false;
+		}
+		task = std::move(tasks.front());
+		tasks.pop();
+	}
+	task();
+	return true;
+}
+
+void ThreadPool::workerLoop() {
+	while (true) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			taskAvailable.wait(lock, [this]() { return stopping || !tasks.empty(); });
+			if (stopping && tasks.empty()) {
+				return;
+			}
+			task = std::move(tasks.front());
+			tasks.pop();
+		}
+		task();
+	}
+}